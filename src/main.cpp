@@ -40,6 +40,52 @@ inline size_t BracketsAreComplete(const std::string& str){
 	return score;
 }
 
+inline bool ParseGCThreads(const char* str){
+	char* end;
+	size_t count = strtoul(str,&end,10);
+	if (*str=='\0'||*end!='\0'||count==0)
+		return false;
+	gGCThreads = count;
+	return true;
+}
+
+// sizes take an optional k, m or g suffix
+inline bool ParseSize(const char* str,size_t* size){
+	char* end;
+	size_t n = strtoull(str,&end,10);
+	if (*str<'0'||*str>'9')
+		return false;
+	switch (*end){
+		case 'k':
+		case 'K':
+			n <<= 10;
+			++end;
+			break;
+		case 'm':
+		case 'M':
+			n <<= 20;
+			++end;
+			break;
+		case 'g':
+		case 'G':
+			n <<= 30;
+			++end;
+			break;
+		default:
+			break;
+	}
+	if (*end!='\0')
+		return false;
+	*size = n;
+	return true;
+}
+
+inline bool ParseFactor(const char* str,double* factor){
+	char* end;
+	*factor = strtod(str,&end);
+	return *str!='\0'&&*end=='\0';
+}
+
 void ReplLoop(CodeInterpreter* interp,bool debug){
 	std::cout << "====slang v" SLANG_VERSION "====\n";
 	std::string inputStr{};
@@ -93,8 +139,6 @@ bool RunProgram(
 		bool shouldDebug,
 		bool interactive,
 		SlangHeader** res){
-	//if (shouldDebug)
-		//interp->codeWriter.optimize = false;
 	if (!interp->LoadProgram(filename,code)){
 		interp->DisplayErrors();
 		return false;
@@ -147,6 +191,8 @@ int main(int argc,char** argv){
 	bool cmdlineProg = false;
 	bool interactive = false;
 	bool shouldDebug = false;
+	bool optimize = true;
+	std::string profileFile{};
 
 #ifdef _WIN32
 	DWORD mode;
@@ -155,6 +201,12 @@ int main(int argc,char** argv){
 	SetConsoleMode(h,mode|ENABLE_VIRTUAL_TERMINAL_PROCESSING);
 #endif
 	
+	const char* gcThreads = getenv("SLANG_GC_THREADS");
+	if (gcThreads&&!ParseGCThreads(gcThreads)){
+		std::cout << "slang: bad thread count " << gcThreads << " in SLANG_GC_THREADS\n";
+		return 1;
+	}
+	
 	std::vector<std::string> argVec{};
 	for (ssize_t i=1;i<argc;++i){
 		argVec.emplace_back(argv[i]);
@@ -166,7 +218,76 @@ int main(int argc,char** argv){
 	for (size_t i=0;i<argVec.size();++i){
 		if (argVec[i]=="--info")
 			showInfo = true;
-		else if (argVec[i]=="-p"||argVec[i]=="--program"){
+		else if (argVec[i]=="--profile-ops"){
+#ifdef SLANG_PROFILE_OPS
+			gProfileOps = true;
+#else
+			std::cout << "slang: --profile-ops needs a build with SLANG_PROFILE_OPS\n";
+			return 1;
+#endif
+		}
+		else if (argVec[i]=="--jit-threshold"){
+			if (i+1>=argVec.size()){
+				std::cout << "slang: expected call count after --jit-threshold\n";
+				return 1;
+			}
+#ifdef SLANG_JIT
+			const char* count = argVec[++i].c_str();
+			char* end;
+			gJitThreshold = strtoul(count,&end,10);
+			if (*count=='\0'||*end!='\0'){
+				std::cout << "slang: bad call count " << count << " after --jit-threshold\n";
+				return 1;
+			}
+#else
+			std::cout << "slang: --jit-threshold needs a build with SLANG_JIT\n";
+			return 1;
+#endif
+		}
+		else if (argVec[i]=="--gc-threads"){
+			if (i+1>=argVec.size()){
+				std::cout << "slang: expected thread count after --gc-threads\n";
+				return 1;
+			}
+			const char* count = argVec[++i].c_str();
+			if (!ParseGCThreads(count)){
+				std::cout << "slang: bad thread count " << count << " after --gc-threads\n";
+				return 1;
+			}
+		}
+		else if (argVec[i]=="--gc-min-heap"||argVec[i]=="--gc-max-heap"){
+			if (i+1>=argVec.size()){
+				std::cout << "slang: expected size after " << argVec[i] << "\n";
+				return 1;
+			}
+			size_t* dest = argVec[i]=="--gc-min-heap" ? &gGCConfig.minHeap : &gGCConfig.maxHeap;
+			const char* size = argVec[++i].c_str();
+			if (!ParseSize(size,dest)){
+				std::cout << "slang: bad size " << size << " after " << argVec[i-1] << "\n";
+				return 1;
+			}
+		}
+		else if (argVec[i]=="--gc-grow"||argVec[i]=="--gc-shrink"){
+			if (i+1>=argVec.size()){
+				std::cout << "slang: expected factor after " << argVec[i] << "\n";
+				return 1;
+			}
+			double* dest = argVec[i]=="--gc-grow" ? &gGCConfig.growFactor : &gGCConfig.shrinkFree;
+			const char* factor = argVec[++i].c_str();
+			if (!ParseFactor(factor,dest)){
+				std::cout << "slang: bad factor " << factor << " after " << argVec[i-1] << "\n";
+				return 1;
+			}
+		}
+		else if (argVec[i]=="--gc-trace")
+			gGCConfig.trace = true;
+		else if (argVec[i]=="--profile"){
+			if (i+1>=argVec.size()){
+				std::cout << "slang: expected output file after --profile\n";
+				return 1;
+			}
+			profileFile = argVec[++i];
+		} else if (argVec[i]=="-p"||argVec[i]=="--program"){
 			if (!filenames.empty()){
 				std::cout << "slang: -p must come before any programs!";
 				return 1;
@@ -176,6 +297,8 @@ int main(int argc,char** argv){
 			interactive = true;
 		else if (argVec[i]=="-g")
 			shouldDebug = true;
+		else if (argVec[i]=="--no-opt")
+			optimize = false;
 		else if (argVec[i].starts_with("-")){
 			std::cout << "slang: unknown command line arg " << argVec[i] << "\n";
 			return 1;
@@ -187,6 +310,12 @@ int main(int argc,char** argv){
 		}
 	}
 	
+	const char* gcConfigError = CheckGCConfig(gGCConfig);
+	if (gcConfigError){
+		std::cout << "slang: " << gcConfigError << "\n";
+		return 1;
+	}
+	
 	if (cmdlineProg&&prog.empty()){
 		std::cout << "slang: expected program after -p\n";
 		return 1;
@@ -199,6 +328,19 @@ int main(int argc,char** argv){
 	SlangHeader* res = nullptr;
 	
 	CodeInterpreter* interp = new CodeInterpreter();
+	// keep the bytecode as written when debugging
+	interp->codeWriter.optimize = optimize&&!shouldDebug;
+#ifdef SLANG_JIT
+	// the debugger steps bytecode
+	if (shouldDebug)
+		gJitThreshold = 0;
+#endif
+	if (!profileFile.empty()&&!StartSampleProfiler(1000)){
+		std::cout << "slang: could not start the sampling profiler\n";
+		return 1;
+	}
+	
+	int exitCode = 0;
 	if (!cmdlineProg&&!filenames.empty()){
 		for (const auto& filename : filenames){
 			std::string code;
@@ -213,21 +355,38 @@ int main(int argc,char** argv){
 				code = std::string(size,'\0');
 				f.read(code.data(),size);
 			}
-			if (!RunProgram(interp,filename,code,shouldDebug,interactive,&res))
-				return 1;
+			if (!RunProgram(interp,filename,code,shouldDebug,interactive,&res)){
+				exitCode = 1;
+				break;
+			}
 		}
 	} else if (cmdlineProg){
 		if (!RunProgram(interp,"<cmdline>",prog,shouldDebug,interactive,&res))
-			return 1;
-		if (res){
+			exitCode = 1;
+		else if (res){
 			std::cout << *res << '\n';
 		}
 	} else {
 		ReplLoop(interp,shouldDebug);
 	}
 	
+	if (!profileFile.empty()){
+		StopSampleProfiler();
+		if (!interp->WriteProfileSamples(profileFile)){
+			std::cout << "slang: cannot write profile " << profileFile << "\n";
+			exitCode = 1;
+		}
+	}
+	
+	if (exitCode)
+		return exitCode;
+	
 	if (showInfo)
 		PrintInfo();
+#ifdef SLANG_PROFILE_OPS
+	if (gProfileOps)
+		PrintOpProfile();
+#endif
 		
 	delete interp;
 	
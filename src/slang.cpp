@@ -8,19 +8,41 @@
 #include <time.h>
 #include <set>
 #include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <mutex>
 #ifdef _WIN32
 #include <profileapi.h>
 #include <sys/timeb.h>
 #include <conio.h>
 #else
 #include <sys/ioctl.h>
+#include <sys/time.h>
 #include <termios.h>
 #endif
+#ifdef SLANG_JIT
+#include <sys/mman.h>
+#endif
+#ifdef SLANG_PROFILE_OPS
+#include <iomanip>
+#ifdef _WIN32
+#include <intrin.h>
+#elif defined(__x86_64__)||defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #define GEN_FLAG (1ULL<<63)
 #define LET_SELF_SYM GEN_FLAG
 #define EMPTY_NAME (-1ULL)
 #define SLANG_FILE_EXT ".sl"
+#define PROFILE_MAX_DEPTH 64
+// read-bytes! from a file grows its result by this much at a time
+#define READ_BYTES_CHUNK (1<<20)
 
 #ifdef _WIN32
 #define PATH_SEP '\\'
@@ -38,14 +60,29 @@ size_t gMaxStackHeight = 0;
 size_t gNameCollisions = 0;
 size_t gHeapAllocTotal = 0;
 size_t gSmallGCs = 0;
+size_t gMinorGCs = 0;
 size_t gReallocCount = 0;
 size_t gMaxArenaSize = 0;
 size_t gArenaSize = 0;
 size_t gCurrDepth = 0;
 size_t gMaxDepth = 0;
 size_t gCaseMisses = 0;
+size_t gGCThreads = 1;
+GCConfig gGCConfig{};
+size_t gParallelGCs = 0;
+double gGCPauseTotal = 0.0;
+double gGCPauseMax = 0.0;
 double gCompileTime = 0.0;
 double gRunTime = 0.0;
+#ifdef SLANG_PROFILE_OPS
+bool gProfileOps = false;
+#endif
+#ifdef SLANG_JIT
+uint32_t gJitThreshold = 100;
+size_t gJitBlocks = 0;
+size_t gJitCodeSize = 0;
+#endif
+std::atomic<uint32_t> gProfileTicks{0};
 
 size_t gEvalCounter = 0;
 size_t gEvalRecurCounter = 0;
@@ -296,6 +333,10 @@ inline const char* TypeToString(SlangType type){
 			return "Real";
 		case SlangType::Maybe:
 			return "Maybe";
+		case SlangType::Iterator:
+			return "Iter";
+		case SlangType::Packed:
+			return "Packed";
 		case SlangType::Vector:
 			return "Vec";
 		case SlangType::String:
@@ -347,6 +388,9 @@ inline size_t SlangHeader::GetSize() const {
 		case SlangType::String: {
 			return sizeof(SlangStr);
 		}
+		case SlangType::Packed: {
+			return sizeof(SlangPacked);
+		}
 		case SlangType::Dict: {
 			return sizeof(SlangDict);
 		}
@@ -365,6 +409,8 @@ inline size_t SlangHeader::GetSize() const {
 			return sizeof(SlangLambda);
 		case SlangType::List:
 			return sizeof(SlangList);
+		case SlangType::Iterator:
+			return sizeof(SlangIter);
 		case SlangType::EndOfFile:
 		case SlangType::Bool:
 			return sizeof(SlangHeader);
@@ -378,7 +424,7 @@ inline size_t SlangHeader::GetSize() const {
 
 bool IsHashable(const SlangHeader* obj){
 	if (!obj) return true;
-	switch (obj->type){
+	switch (GetType(obj)){
 		case SlangType::Bool:
 		case SlangType::Int:
 		case SlangType::Real:
@@ -389,6 +435,8 @@ bool IsHashable(const SlangHeader* obj){
 		case SlangType::String:
 		case SlangType::List:
 		case SlangType::Maybe:
+		case SlangType::Iterator:
+		case SlangType::Packed:
 			return true;
 	
 		case SlangType::NullType:
@@ -405,15 +453,15 @@ bool IsHashable(const SlangHeader* obj){
 
 uint64_t SlangHashObj(const SlangHeader* obj){
 	if (!obj) return 3;
-	switch (obj->type){
+	switch (GetType(obj)){
 		case SlangType::EndOfFile:
 			return 4;
 		case SlangType::Bool:
-			return obj->boolVal;
+			return GetBool(obj);
 		case SlangType::Int:
-			return ((SlangObj*)obj)->integer;
+			return GetInt(obj);
 		case SlangType::Real:
-			return ((SlangObj*)obj)->integer;
+			return std::bit_cast<uint64_t>(GetReal(obj));
 		case SlangType::Symbol:
 			return ((SlangObj*)obj)->symbol;
 		case SlangType::Lambda:
@@ -438,6 +486,17 @@ uint64_t SlangHashObj(const SlangHeader* obj){
 			}
 			return h^str->storage->size;
 		}
+		case SlangType::Packed: {
+			SlangPacked* packed = (SlangPacked*)obj;
+			uint64_t h = 18^packed->header.packKind;
+			if (!packed->storage) return h;
+			size_t byteCount = packed->storage->size*packed->storage->header.elemSize;
+			for (size_t i=0;i<byteCount;++i){
+				h = rotleft(h,1);
+				h ^= packed->storage->data[i];
+			}
+			return h^packed->storage->size;
+		}
 		case SlangType::List: {
 			SlangList* list = (SlangList*)obj;
 			uint64_t h = 7^SlangHashObj(list->left);
@@ -451,6 +510,16 @@ uint64_t SlangHashObj(const SlangHeader* obj){
 				h ^= SlangHashObj(o->maybe);
 			return h;
 		}
+		case SlangType::Iterator: {
+			// only ranges are ever hashed, see EqualObjs
+			SlangIter* it = (SlangIter*)obj;
+			uint64_t h = 17^it->count;
+			if (it->count)
+				h ^= rotleft(it->pos,3);
+			if (it->count>1)
+				h ^= rotleft(it->step,7);
+			return h;
+		}
 		
 		case SlangType::NullType:
 		case SlangType::Dict:
@@ -467,6 +536,8 @@ uint64_t SlangHashObj(const SlangHeader* obj){
 struct EvacData {
 	uint8_t** write;
 	MemArena* arena;
+	// minor collections leave currSet in place
+	bool minor;
 };
 
 typedef void(*WalkFunc)(SlangHeader** ref,void* data);
@@ -486,9 +557,11 @@ inline void SlangWalkRefs(SlangHeader* obj,WalkFunc func,void* data){
 		}
 		case SlangType::Vector: {
 			SlangVec* vec = (SlangVec*)obj;
-			func((SlangHeader**)&vec->storage,data);
+			// read back through the same pointer type func wrote with
+			SlangHeader** storageRef = (SlangHeader**)&vec->storage;
+			func(storageRef,data);
 			
-			SlangStorage* storage = vec->storage;
+			SlangStorage* storage = (SlangStorage*)*storageRef;
 			if (storage){
 				for (size_t i=0;i<storage->size;++i){
 					func(&storage->objs[i],data);
@@ -499,9 +572,10 @@ inline void SlangWalkRefs(SlangHeader* obj,WalkFunc func,void* data){
 		case SlangType::Dict: {
 			SlangDict* dict = (SlangDict*)obj;
 			func((SlangHeader**)&dict->table,data);
-			func((SlangHeader**)&dict->storage,data);
+			SlangHeader** storageRef = (SlangHeader**)&dict->storage;
+			func(storageRef,data);
 			
-			SlangStorage* storage = dict->storage;
+			SlangStorage* storage = (SlangStorage*)*storageRef;
 			if (storage){
 				for (size_t i=0;i<storage->size;++i){
 					SlangDictElement* elem = &storage->elements[i];
@@ -527,6 +601,12 @@ inline void SlangWalkRefs(SlangHeader* obj,WalkFunc func,void* data){
 			func((SlangHeader**)&str->storage,data);
 			return;
 		}
+		case SlangType::Packed: {
+			// the elements aren't objects, only the storage is walked
+			SlangPacked* packed = (SlangPacked*)obj;
+			func((SlangHeader**)&packed->storage,data);
+			return;
+		}
 		case SlangType::Maybe: {
 			SlangObj* maybe = (SlangObj*)obj;
 			if (maybe->header.flags & FLAG_MAYBE_OCCUPIED){
@@ -534,13 +614,19 @@ inline void SlangWalkRefs(SlangHeader* obj,WalkFunc func,void* data){
 			}
 			return;
 		}
+		case SlangType::Iterator: {
+			SlangIter* it = (SlangIter*)obj;
+			func(&it->source,data);
+			return;
+		}
 		case SlangType::InputStream:
 		case SlangType::OutputStream: {
 			SlangStream* stream = (SlangStream*)obj;
 			if (!stream->header.isFile){
-				func((SlangHeader**)&stream->str,data);
-				if (stream->str)
-					func((SlangHeader**)&stream->str->storage,data);
+				SlangHeader** strRef = (SlangHeader**)&stream->str;
+				func(strRef,data);
+				if (*strRef)
+					func((SlangHeader**)&((SlangStr*)*strRef)->storage,data);
 			}
 			return;
 		}
@@ -559,9 +645,12 @@ inline void SlangWalkRefs(SlangHeader* obj,WalkFunc func,void* data){
 }
 
 inline SlangHeader* Evacuate(SlangHeader* obj,EvacData* data){
-	if (!obj) return nullptr;
-	if (!data->arena->InCurrSet((uint8_t*)obj)){
-		
+	if (!obj||IsImmediate(obj)) return obj;
+	if (!data->arena->InNursery((uint8_t*)obj) &&
+			(data->minor||!data->arena->InCurrSet((uint8_t*)obj))){
+		// large storage is marked where it is instead of copied
+		if (!data->minor&&(obj->flags & FLAG_LARGE))
+			obj->flags |= FLAG_MARKED;
 		return obj;
 	}
 	
@@ -578,7 +667,7 @@ inline SlangHeader* Evacuate(SlangHeader* obj,EvacData* data){
 }
 
 void EvacuateOrForward(SlangHeader** obj,EvacData* data){
-	if (*obj && (*obj)->IsForwarded())
+	if (*obj && !IsImmediate(*obj) && (*obj)->IsForwarded())
 		*obj = (*obj)->GetForwardAddress();
 	else
 		*obj = Evacuate(*obj,data);
@@ -592,11 +681,108 @@ inline void Scavenge(uint8_t* read,EvacData* data){
 	}
 }
 
+inline void ScanRemembered(SlangHeader* obj,EvacData* data){
+	obj->flags &= ~FLAG_REMEMBERED;
+	if (obj->type!=SlangType::Env){
+		SlangWalkRefs(obj,(WalkFunc)&EvacuateOrForward,(void*)data);
+		return;
+	}
+	
+	// env writes are remembered on the first block only
+	while (obj){
+		SlangWalkRefs(obj,(WalkFunc)&EvacuateOrForward,(void*)data);
+		SlangHeader** nextRef = (SlangHeader**)&((SlangEnv*)obj)->next;
+		obj = *nextRef;
+	}
+}
+
+inline void EvacuateEnvIndex(EnvIndex& index,EvacData* data){
+	for (size_t i=0;i<index.blockCount;++i){
+		EvacuateOrForward((SlangHeader**)&index.blocks[i],data);
+	}
+}
+
+inline void ForwardEnvIndex(EnvIndex& index){
+	for (size_t i=0;i<index.blockCount;++i){
+		if (index.blocks[i]->header.IsForwarded())
+			index.blocks[i] = (SlangEnv*)index.blocks[i]->header.GetForwardAddress();
+	}
+}
+
 inline void ForwardObjWalker(SlangHeader** obj,void*){
-	if (*obj && (*obj)->IsForwarded())
+	if (*obj && !IsImmediate(*obj) && (*obj)->IsForwarded())
 		*obj = (*obj)->GetForwardAddress();
 }
 
+inline void WalkGCRoots(CodeInterpreter* c,WalkFunc func,void* data){
+	for (size_t i=0;i<c->argStack.size;++i){
+		func(&c->argStack.data[i],data);
+	}
+	
+	for (size_t i=0;i<c->funcStack.size;++i){
+		func((SlangHeader**)&c->funcStack.data[i].env,data);
+		func((SlangHeader**)&c->funcStack.data[i].globalEnv,data);
+	}
+	
+	for (size_t i=0;i<c->modules.size;++i){
+		ModuleData& module = c->modules.data[i];
+		func((SlangHeader**)&module.exportEnv,data);
+		func((SlangHeader**)&module.globalEnv,data);
+		for (size_t j=0;j<module.exportIndex.blockCount;++j){
+			func((SlangHeader**)&module.exportIndex.blocks[j],data);
+		}
+		for (size_t j=0;j<module.globalIndex.blockCount;++j){
+			func((SlangHeader**)&module.globalIndex.blocks[j],data);
+		}
+	}
+	
+	func((SlangHeader**)&c->lamEnv,data);
+}
+
+inline void SweepLargeObjects(MemArena* arena){
+	size_t live = 0;
+	for (size_t i=0;i<arena->largeObjects.size;++i){
+		SlangHeader* obj = arena->largeObjects.data[i];
+		if (obj->flags & FLAG_MARKED){
+			obj->flags &= ~FLAG_MARKED;
+			live += obj->GetSize();
+		} else {
+			free(obj);
+			arena->largeObjects.data[i--] = arena->largeObjects.data[--arena->largeObjects.size];
+		}
+	}
+	arena->largeSize = live;
+	arena->largeLimit = std::max(live*2,(size_t)LARGE_SPACE_MIN);
+}
+
+const char* CheckGCConfig(const GCConfig& config){
+	if (config.minHeap<SMALL_SET_SIZE/16)
+		return "Min heap must be at least 4 KB!";
+	if (config.maxHeap&&config.maxHeap<config.minHeap)
+		return "Max heap must be 0 or at least the min heap!";
+	if (!(config.growFactor>1.0&&config.growFactor<=16.0))
+		return "Grow factor must be above 1 and at most 16!";
+	// at 1/2 a set shrunk to live*growFactor could shrink again right away
+	if (!(config.shrinkFree>=0.5&&config.shrinkFree<=1.0))
+		return "Shrink free fraction must be between 0.5 and 1!";
+	return nullptr;
+}
+
+inline void RecordGC(MemArena* arena,const char* kind,size_t count,double start,size_t copied){
+	double pause = GetDoublePerfTime()-start;
+	gGCPauseTotal += pause;
+	gGCPauseMax = (pause > gGCPauseMax) ? pause : gGCPauseMax;
+	if (!gGCConfig.trace)
+		return;
+	
+	size_t live = arena->currPointer-arena->currSet+arena->largeSize;
+	std::cerr << "gc " << kind << ' ' << count << ": copied " << copied << 
+		", live " << live << ", heap " << arena->memSize/2 << ", pause " <<
+		std::fixed << std::setprecision(3) << pause*1000 << "ms\n";
+}
+
+#include "pargc.cpp.inc"
+
 inline void CodeInterpreter::ReallocSet(size_t newSize){
 	newSize = QuantizeSize16(newSize);
 	// shrinking and the arena sets have good parity
@@ -614,6 +800,7 @@ inline void CodeInterpreter::ReallocSet(size_t newSize){
 	}
 	
 	uint8_t* newPtr = (uint8_t*)malloc(newSize);
+	++gcEpoch;
 	
 	// copy over data
 	size_t currPointerLen = arena->currPointer-arena->currSet;
@@ -643,10 +830,12 @@ inline void CodeInterpreter::ReallocSet(size_t newSize){
 		if (modules.data[i].globalEnv && modules.data[i].globalEnv->header.IsForwarded())
 			modules.data[i].globalEnv = 
 				(SlangEnv*)modules.data[i].globalEnv->header.GetForwardAddress();
+		ForwardEnvIndex(modules.data[i].exportIndex);
+		ForwardEnvIndex(modules.data[i].globalIndex);
 	}
 	
 	for (size_t i=0;i<argStack.size;++i){
-		if (argStack.data[i] && argStack.data[i]->IsForwarded())
+		if (argStack.data[i] && !IsImmediate(argStack.data[i]) && argStack.data[i]->IsForwarded())
 			argStack.data[i] = argStack.data[i]->GetForwardAddress();
 	}
 	for (size_t i=0;i<funcStack.size;++i){
@@ -674,10 +863,20 @@ inline void CodeInterpreter::ReallocSet(size_t newSize){
 	++gReallocCount;
 }
 
-inline void CodeInterpreter::SmallGC(size_t allocAttempt){
-	uint8_t* write = arena->otherSet;
+inline void CodeInterpreter::MinorGC(){
+	size_t used = arena->NurseryUsed();
+	ssize_t spaceLeft = arena->currSet+arena->memSize/2-arena->currPointer;
+	// survivors might not fit in currSet, or enough large
+	// storage was allocated that some of it is likely dead
+	if (spaceLeft<(ssize_t)used||arena->largeSize>arena->largeLimit){
+		SmallGC(arena->nurserySize);
+		return;
+	}
+	
+	double start = GetDoublePerfTime();
+	uint8_t* write = arena->currPointer;
 	uint8_t* read = write;
-	EvacData data = {&write,arena};
+	EvacData data = {&write,arena,true};
 	
 	for (size_t i=0;i<argStack.size;++i){
 		EvacuateOrForward(&argStack.data[i],&data);
@@ -691,42 +890,139 @@ inline void CodeInterpreter::SmallGC(size_t allocAttempt){
 	for (size_t i=0;i<modules.size;++i){
 		EvacuateOrForward((SlangHeader**)&modules.data[i].exportEnv,&data);
 		EvacuateOrForward((SlangHeader**)&modules.data[i].globalEnv,&data);
+		EvacuateEnvIndex(modules.data[i].exportIndex,&data);
+		EvacuateEnvIndex(modules.data[i].globalIndex,&data);
 	}
 	
 	EvacuateOrForward((SlangHeader**)&lamEnv,&data);
 	
+	for (size_t i=0;i<rememberedSet.size;++i){
+		ScanRemembered(rememberedSet.data[i],&data);
+	}
+	rememberedSet.Clear();
+	
+	// everything allocated straight into currSet can hold young refs
+	uint8_t* direct = arena->directStart;
+	while (direct<read){
+		SlangHeader* obj = (SlangHeader*)direct;
+		direct += obj->GetSize();
+		SlangWalkRefs(obj,(WalkFunc)&EvacuateOrForward,(void*)&data);
+	}
+	
 	Scavenge(read,&data);
 	
-	arena->SwapSets();
+	if (nurseryCached){
+		++gcEpoch;
+		nurseryCached = false;
+	}
 	arena->currPointer = write;
+	arena->directStart = write;
+	arena->nurseryPointer = arena->nursery;
 	
 	for (size_t i=0;i<finalizers.size;++i){
 		auto& finalizer = finalizers.data[i];
+		if (!arena->InNursery((uint8_t*)finalizer.obj))
+			continue;
 		if (!finalizer.obj->IsForwarded()){
 			finalizer.func(this,finalizer.obj);
-			finalizers.data[i] = finalizers.data[--finalizers.size];
+			finalizers.data[i--] = finalizers.data[--finalizers.size];
+		} else {
+			finalizer.obj = finalizer.obj->GetForwardAddress();
+		}
+	}
+	
+	++gMinorGCs;
+	RecordGC(arena,"minor",gMinorGCs,start,write-read);
+}
+
+inline void CodeInterpreter::SmallGC(size_t allocAttempt){
+	double start = GetDoublePerfTime();
+	for (size_t i=0;i<rememberedSet.size;++i){
+		rememberedSet.data[i]->flags &= ~FLAG_REMEMBERED;
+	}
+	rememberedSet.Clear();
+	
+	uint8_t* write = arena->otherSet;
+	// the nursery has to be emptied along with currSet, so
+	// copy into a bigger space when both can't fit
+	size_t used = arena->currPointer-arena->currSet+arena->NurseryUsed();
+	bool parallel = gGCThreads>1&&used>=PARALLEL_GC_MIN_SIZE;
+	size_t need = parallel ? ParallelGCSpace(used,gGCThreads) : used;
+	size_t newSize = 0;
+	if (need>arena->memSize/2){
+		newSize = QuantizeSize16(std::max(used*3,need*2));
+		write = (uint8_t*)malloc(newSize);
+	}
+	uint8_t* newSet = write;
+	++gcEpoch;
+	
+	if (parallel){
+		size_t setSize = newSize ? newSize/2 : arena->memSize/2;
+		write = ParallelEvacuate(this,newSet,newSet+setSize);
+	} else {
+		uint8_t* read = write;
+		EvacData data = {&write,arena,false};
+		WalkGCRoots(this,(WalkFunc)&EvacuateOrForward,(void*)&data);
+		Scavenge(read,&data);
+	}
+	
+	if (newSize){
+		free(arena->memSet);
+		arena->SetSpace(newSet,newSize,write);
+		gMaxArenaSize = (newSize > gMaxArenaSize) ?
+							newSize : gMaxArenaSize;
+		gArenaSize = newSize;
+		++gReallocCount;
+	} else {
+		arena->SwapSets();
+		arena->currPointer = write;
+		arena->directStart = write;
+	}
+	arena->nurseryPointer = arena->nursery;
+	SweepLargeObjects(arena);
+	
+	for (size_t i=0;i<finalizers.size;++i){
+		auto& finalizer = finalizers.data[i];
+		if (!finalizer.obj->IsForwarded()){
+			finalizer.func(this,finalizer.obj);
+			finalizers.data[i--] = finalizers.data[--finalizers.size];
 		} else {
 			finalizer.obj = finalizer.obj->GetForwardAddress();
 		}
 	}
 	
+	size_t copied = write-newSet;
+	size_t live = write-arena->currSet;
 	ssize_t spaceLeft = arena->currSet+arena->memSize/2-write;
+	size_t maxMem = gGCConfig.maxHeap*2;
 	// less than 1/4 of the set left
 	if (spaceLeft-(ssize_t)allocAttempt<(ssize_t)arena->memSize/8){
-		ReallocSet((arena->memSize)*3/2+allocAttempt*2);
-	} else if (arena->memSize>SMALL_SET_SIZE*4&&spaceLeft>(ssize_t)arena->memSize*7/16){
-		// set more than 7/8 empty
-		size_t m = std::max((size_t)(arena->memSize-spaceLeft*2)*3/2,(size_t)SMALL_SET_SIZE*2);
-		ReallocSet(m);
+		size_t m = (size_t)(arena->memSize*gGCConfig.growFactor)+allocAttempt*2;
+		if (maxMem&&m>maxMem)
+			m = std::max(maxMem,arena->memSize);
+		if (m>arena->memSize)
+			ReallocSet(m);
+	} else if (arena->memSize>gGCConfig.minHeap*4&&
+			spaceLeft>(ssize_t)(arena->memSize/2*gGCConfig.shrinkFree)){
+		// set more than shrinkFree empty
+		size_t m = (size_t)(live*2*gGCConfig.growFactor)+allocAttempt*2;
+		m = std::max(m,gGCConfig.minHeap*2);
+		if (m<arena->memSize)
+			ReallocSet(m);
+	}
+	
+	if (maxMem&&live+arena->largeSize+allocAttempt>gGCConfig.maxHeap){
+		std::cout << "slang: heap limit of " << gGCConfig.maxHeap/1024 << " KB exceeded\n";
+		exit(1);
 	}
 	
 	++gSmallGCs;
+	RecordGC(arena,"full",gSmallGCs,start,copied);
 }
 
-inline void* CodeInterpreterAllocate(void* data,size_t mem){
-	CodeInterpreter* c = (CodeInterpreter*)data;
-	assert((mem&7)==0);
-	//c->SmallGC(mem);
+// large objects skip the nursery, MinorGC scans them from
+// arena->directStart since they get young refs without a barrier
+inline void* CodeInterpreterAllocateOld(CodeInterpreter* c,size_t mem){
 	if (c->arena->currPointer+mem<c->arena->currSet+c->arena->memSize/2){
 #ifndef NDEBUG
 		gAllocTotal += mem;
@@ -753,36 +1049,88 @@ inline void* CodeInterpreterAllocate(void* data,size_t mem){
 	return d;
 }
 
+inline void* CodeInterpreterAllocate(void* data,size_t mem){
+	CodeInterpreter* c = (CodeInterpreter*)data;
+	MemArena* arena = c->arena;
+	assert((mem&7)==0);
+	// big objects would only be copied out again
+	if (mem>arena->pretenureSize)
+		return CodeInterpreterAllocateOld(c,mem);
+	
+	if (arena->nurseryPointer+mem<=arena->nursery+arena->nurserySize){
+#ifndef NDEBUG
+		gAllocTotal += mem;
+#endif
+		void* d = arena->nurseryPointer;
+		arena->nurseryPointer += mem;
+		return d;
+	}
+	
+	c->MinorGC();
+#ifndef NDEBUG
+	gAllocTotal += mem;
+#endif
+	void* d = arena->nurseryPointer;
+	arena->nurseryPointer += mem;
+	return d;
+}
+
 inline uint8_t* SlangAllocator::Allocate(size_t size){
+	if (arena){
+		assert((size&7)==0);
+		uint8_t* p = arena->nurseryPointer;
+		if (size<=arena->pretenureSize&&p+size<=arena->nursery+arena->nurserySize) [[likely]] {
+#ifndef NDEBUG
+			gAllocTotal += size;
+#endif
+			arena->nurseryPointer = p+size;
+			return p;
+		}
+	}
 	return (uint8_t*)alloc(user,size);
 }
 
+// sets flags, big storage goes to the large object space
+// and is null if it couldn't be malloced
+inline uint8_t* SlangAllocator::AllocateStorageMem(size_t size){
+	if (arena&&size>=LARGE_STORAGE_SIZE)
+		return arena->AllocateLarge(size);
+	
+	uint8_t* p = Allocate(size);
+	((SlangHeader*)p)->flags = 0;
+	return p;
+}
+
 inline SlangObj* SlangAllocator::AllocateObj(SlangType type){
-	SlangObj* p = (SlangObj*)alloc(user,sizeof(SlangHeader)+sizeof(uint64_t));
+	SlangObj* p = (SlangObj*)Allocate(sizeof(SlangHeader)+sizeof(uint64_t));
 	memset(p,0,sizeof(SlangObj));
 	p->header.type = type;
 	return p;
 }
 
 inline SlangLambda* SlangAllocator::AllocateLambda(){
-	SlangLambda* lam = (SlangLambda*)alloc(user,sizeof(SlangLambda));
+	SlangLambda* lam = (SlangLambda*)Allocate(sizeof(SlangLambda));
 	memset(lam,0,sizeof(SlangLambda));
 	lam->header.type = SlangType::Lambda;
 	return lam;
 }
 
 inline SlangList* SlangAllocator::AllocateList(){
-	SlangList* p = (SlangList*)alloc(user,sizeof(SlangList));
+	SlangList* p = (SlangList*)Allocate(sizeof(SlangList));
 	memset(p,0,sizeof(SlangList));
 	p->header.type = SlangType::List;
 	return p;
 }
 
+// storage, vec, str and packed allocations are null when too big
 inline SlangStorage* SlangAllocator::AllocateStorage(size_t size,uint16_t elemSize){
+	if (size>MAX_STORAGE_SIZE/elemSize)
+		return nullptr;
 	size_t byteCount = QuantizeSize(size*elemSize);
-	SlangStorage* obj = (SlangStorage*)alloc(user,sizeof(SlangStorage)+byteCount);
+	SlangStorage* obj = (SlangStorage*)AllocateStorageMem(sizeof(SlangStorage)+byteCount);
+	if (!obj)
+		return nullptr;
 	obj->header.type = SlangType::Storage;
-	obj->header.flags = 0;
 	obj->header.elemSize = elemSize;
 	obj->size = size;
 	obj->capacity = byteCount/elemSize;
@@ -791,14 +1139,25 @@ inline SlangStorage* SlangAllocator::AllocateStorage(size_t size,uint16_t elemSi
 
 inline SlangVec* SlangAllocator::AllocateVec(size_t size){
 	if (!size){
-		SlangVec* obj = (SlangVec*)alloc(user,sizeof(SlangVec));
+		SlangVec* obj = (SlangVec*)Allocate(sizeof(SlangVec));
 		obj->header.type = SlangType::Vector;
 		obj->header.flags = 0;
 		obj->storage = nullptr;
 		return obj;
 	}
 	
-	uint8_t* data = (uint8_t*)alloc(user,sizeof(SlangVec)+sizeof(SlangStorage)+size*sizeof(SlangHeader*));
+	if (size>MAX_STORAGE_SIZE/sizeof(SlangHeader*))
+		return nullptr;
+	if (arena&&sizeof(SlangStorage)+size*sizeof(SlangHeader*)>=LARGE_STORAGE_SIZE){
+		// large storage can't trigger a collection, so v stays put
+		SlangVec* v = AllocateVec(0);
+		v->storage = AllocateStorage(size,sizeof(SlangHeader*));
+		if (!v->storage)
+			return nullptr;
+		return v;
+	}
+	
+	uint8_t* data = (uint8_t*)Allocate(sizeof(SlangVec)+sizeof(SlangStorage)+size*sizeof(SlangHeader*));
 	SlangVec* v = (SlangVec*)data;
 	SlangStorage* s = (SlangStorage*)(data+sizeof(SlangVec));
 	v->header.type = SlangType::Vector;
@@ -814,16 +1173,25 @@ inline SlangVec* SlangAllocator::AllocateVec(size_t size){
 
 inline SlangStr* SlangAllocator::AllocateStr(size_t size){
 	if (!size){
-		SlangStr* obj = (SlangStr*)alloc(user,sizeof(SlangStr));
+		SlangStr* obj = (SlangStr*)Allocate(sizeof(SlangStr));
 		obj->header.type = SlangType::String;
 		obj->header.flags = 0;
 		obj->storage = nullptr;
 		return obj;
 	}
 	
+	if (size>MAX_STORAGE_SIZE)
+		return nullptr;
 	size_t qSize = QuantizeSize(size);
+	if (arena&&sizeof(SlangStorage)+qSize>=LARGE_STORAGE_SIZE){
+		SlangStr* str = AllocateStr(0);
+		str->storage = AllocateStorage(size,1);
+		if (!str->storage)
+			return nullptr;
+		return str;
+	}
 	
-	uint8_t* data = (uint8_t*)alloc(user,sizeof(SlangStr)+sizeof(SlangStorage)+qSize);
+	uint8_t* data = (uint8_t*)Allocate(sizeof(SlangStr)+sizeof(SlangStorage)+qSize);
 	SlangStr* str = (SlangStr*)data;
 	SlangStorage* s = (SlangStorage*)(data+sizeof(SlangStr));
 	str->header.type = SlangType::String;
@@ -840,9 +1208,8 @@ inline SlangStr* SlangAllocator::AllocateStr(size_t size){
 
 inline SlangStorage* SlangAllocator::AllocateDictStorage(size_t size){
 	size_t byteCount = QuantizeSize(size*sizeof(SlangDictElement));
-	SlangStorage* obj = (SlangStorage*)alloc(user,sizeof(SlangStorage)+byteCount);
+	SlangStorage* obj = (SlangStorage*)AllocateStorageMem(sizeof(SlangStorage)+byteCount);
 	obj->header.type = SlangType::Storage;
-	obj->header.flags = 0;
 	obj->header.elemSize = sizeof(SlangDictElement);
 	obj->size = 0;
 	obj->capacity = size;
@@ -851,7 +1218,7 @@ inline SlangStorage* SlangAllocator::AllocateDictStorage(size_t size){
 
 inline SlangDictTable* SlangAllocator::AllocateDictTable(size_t size){
 	size_t byteCount = size*sizeof(size_t);
-	SlangDictTable* obj = (SlangDictTable*)alloc(user,sizeof(SlangDictTable)+byteCount);
+	SlangDictTable* obj = (SlangDictTable*)Allocate(sizeof(SlangDictTable)+byteCount);
 	obj->header.type = SlangType::DictTable;
 	obj->header.flags = 0;
 	obj->capacity = size;
@@ -860,7 +1227,7 @@ inline SlangDictTable* SlangAllocator::AllocateDictTable(size_t size){
 }
 
 inline SlangDict* SlangAllocator::AllocateDict(){
-	SlangDict* obj = (SlangDict*)alloc(user,sizeof(SlangDict));
+	SlangDict* obj = (SlangDict*)Allocate(sizeof(SlangDict));
 	obj->header.type = SlangType::Dict;
 	obj->header.flags = 0;
 	obj->storage = nullptr;
@@ -869,7 +1236,7 @@ inline SlangDict* SlangAllocator::AllocateDict(){
 }
 
 inline SlangEnv* SlangAllocator::AllocateEnv(){
-	SlangEnv* obj = (SlangEnv*)alloc(user,sizeof(SlangEnv));
+	SlangEnv* obj = (SlangEnv*)Allocate(sizeof(SlangEnv));
 	obj->header.type = SlangType::Env;
 	obj->header.flags = 0;
 	obj->header.varCount = 0;
@@ -879,31 +1246,77 @@ inline SlangEnv* SlangAllocator::AllocateEnv(){
 }
 
 inline SlangStream* SlangAllocator::AllocateStream(SlangType type){
-	SlangStream* stream = (SlangStream*)alloc(user,sizeof(SlangStream));
+	SlangStream* stream = (SlangStream*)Allocate(sizeof(SlangStream));
 	stream->header.type = type;
 	stream->header.flags = 0;
 	stream->str = nullptr;
 	return stream;
 }
 
-inline SlangObj* SlangAllocator::MakeInt(int64_t i){
+inline SlangIter* SlangAllocator::AllocateIter(uint8_t kind){
+	SlangIter* it = (SlangIter*)Allocate(sizeof(SlangIter));
+	memset(it,0,sizeof(SlangIter));
+	it->header.type = SlangType::Iterator;
+	it->header.iterKind = kind;
+	return it;
+}
+
+inline SlangPacked* SlangAllocator::AllocatePacked(uint8_t kind,size_t size){
+	uint16_t elemSize = PackElemSize(kind);
+	if (size>MAX_STORAGE_SIZE/elemSize)
+		return nullptr;
+	if (!size||(arena&&sizeof(SlangStorage)+size*elemSize>=LARGE_STORAGE_SIZE)){
+		SlangPacked* obj = (SlangPacked*)Allocate(sizeof(SlangPacked));
+		obj->header.type = SlangType::Packed;
+		obj->header.flags = 0;
+		obj->header.packKind = kind;
+		obj->storage = nullptr;
+		// large storage can't trigger a collection, so obj stays put
+		if (size){
+			obj->storage = AllocateStorage(size,elemSize);
+			if (!obj->storage)
+				return nullptr;
+		}
+		return obj;
+	}
+	
+	size_t byteCount = QuantizeSize(size*elemSize);
+	uint8_t* data = (uint8_t*)Allocate(sizeof(SlangPacked)+sizeof(SlangStorage)+byteCount);
+	SlangPacked* p = (SlangPacked*)data;
+	SlangStorage* s = (SlangStorage*)(data+sizeof(SlangPacked));
+	p->header.type = SlangType::Packed;
+	p->header.flags = 0;
+	p->header.packKind = kind;
+	p->storage = s;
+	s->header.type = SlangType::Storage;
+	s->header.flags = 0;
+	s->header.elemSize = elemSize;
+	s->capacity = byteCount/elemSize;
+	s->size = size;
+	return p;
+}
+
+inline SlangHeader* SlangAllocator::MakeInt(int64_t i){
+	if (FitsImmInt(i))
+		return MakeImmInt(i);
+	// only ints outside the immediate range get boxed
 	SlangObj* obj = AllocateObj(SlangType::Int);
 	obj->integer = i;
-	return obj;
+	return (SlangHeader*)obj;
 }
 
-inline SlangObj* SlangAllocator::MakeReal(double r){
+inline SlangHeader* SlangAllocator::MakeReal(double r){
+#ifdef SLANG_NAN_BOXING
+	return MakeImmReal(r);
+#else
 	SlangObj* obj = AllocateObj(SlangType::Real);
 	obj->real = r;
-	return obj;
+	return (SlangHeader*)obj;
+#endif
 }
 
 inline SlangHeader* SlangAllocator::MakeBool(bool b){
-	SlangHeader* obj = (SlangHeader*)alloc(user,sizeof(SlangHeader));
-	obj->type = SlangType::Bool;
-	obj->flags = 0;
-	obj->boolVal = b;
-	return obj;
+	return MakeImmBool(b);
 }
 
 inline SlangObj* SlangAllocator::MakeSymbol(SymbolName symbol){
@@ -913,10 +1326,7 @@ inline SlangObj* SlangAllocator::MakeSymbol(SymbolName symbol){
 }
 
 inline SlangHeader* SlangAllocator::MakeEOF(){
-	SlangHeader* obj = (SlangHeader*)alloc(user,sizeof(SlangHeader));
-	obj->type = SlangType::EndOfFile;
-	obj->flags = 0;
-	return obj;
+	return SLANG_IMM_EOF;
 }
 
 inline void SlangEnv::AddBlock(SlangEnv* newEnv){
@@ -991,9 +1401,9 @@ inline size_t GetArgCount(const SlangList* arg){
 }
 
 size_t GetRecursiveSize(SlangHeader* obj){
-	if (!obj) return 0;
+	if (!obj||IsImmediate(obj)) return 0;
 	
-	switch (obj->type){
+	switch (GetType(obj)){
 		case SlangType::Int:
 		case SlangType::Real:
 		case SlangType::Bool:
@@ -1050,6 +1460,10 @@ size_t GetRecursiveSize(SlangHeader* obj){
 			return obj->GetSize()+GetRecursiveSize(((SlangObj*)obj)->maybe);
 		}
 		
+		case SlangType::Iterator: {
+			return obj->GetSize()+GetRecursiveSize(((SlangIter*)obj)->source);
+		}
+		
 		case SlangType::String: {
 			size_t c = obj->GetSize();
 			SlangStr* str = (SlangStr*)obj;
@@ -1057,6 +1471,14 @@ size_t GetRecursiveSize(SlangHeader* obj){
 			return c;
 		}
 		
+		case SlangType::Packed: {
+			size_t c = obj->GetSize();
+			SlangPacked* packed = (SlangPacked*)obj;
+			if (packed->storage)
+				c += packed->storage->header.GetSize();
+			return c;
+		}
+		
 		case SlangType::Env: {
 			size_t c = obj->GetSize();
 			SlangEnv* env = (SlangEnv*)obj;
@@ -1103,52 +1525,36 @@ inline bool GetRecursiveSymbol(SlangEnv* e,SymbolName name,SlangHeader** val){
 	return false;
 }
 
-inline bool CodeInterpreter::GetStackSymbol(size_t funcFrame,SymbolName sym,SlangHeader** res){
-	//for (size_t i=funcFrame;i!=-1ULL;--i){
-	FuncData& f = funcStack.data[funcFrame];
-	size_t funcIndex = f.funcIndex;
-	if (sym==codeWriter.lambdaCodes[funcIndex].name){
-		return GetRecursiveSymbol(f.env,sym,res);
-	}
-	const ParamData& params = codeWriter.lambdaCodes[funcIndex].params;
-	for (size_t j=0;j<params.size;++j){
-		if (params.data[j]==sym){
-			size_t funcBase = stack.data[f.argsFrame].base;
-			*res = argStack.data[funcBase+j];
-			return true;
-		}
-	}
-	const ParamData& defs = codeWriter.lambdaCodes[funcIndex].defs;
-	for (size_t j=0;j<defs.size;++j){
-		if (defs.data[j]==sym){
-			size_t funcBase = stack.data[f.argsFrame].base;
-			*res = argStack.data[funcBase+params.size+j];
-			return true;
-		}
-	}
-	//}
-	return GetRecursiveSymbol(GetCurrEnv(),sym,res);
-}
-
 inline bool ConvertToBool(const SlangHeader* obj){
 	if (!obj){
 		return false;
 	}
+	if (IsImmediate(obj)){
+		if (IsImmInt(obj))
+			return obj!=MakeImmInt(0);
+		if (IsImmReal(obj))
+			return (bool)GetReal(obj);
+		return obj==SLANG_IMM_TRUE;
+	}
 	
-	switch (obj->type){
+	switch (GetType(obj)){
 		case SlangType::NullType:
 		case SlangType::Storage:
 		case SlangType::DictTable:
 		case SlangType::EndOfFile:
 			return false;
 		case SlangType::Bool:
-			return obj->boolVal;
+			return GetBool(obj);
 		case SlangType::Int:
-			return (bool)((SlangObj*)obj)->integer;
+			return (bool)GetInt(obj);
 		case SlangType::Real:
-			return (bool)((SlangObj*)obj)->real;
+			return (bool)GetReal(obj);
 		case SlangType::Maybe:
 			return (obj->flags&FLAG_MAYBE_OCCUPIED)!=0;
+		case SlangType::Iterator:
+			return ((SlangIter*)obj)->count!=0;
+		case SlangType::Packed:
+			return ((SlangPacked*)obj)->GetLength()!=0;
 		case SlangType::Vector: {
 			SlangVec* vec = (SlangVec*)obj;
 			if (!vec->storage){
@@ -1238,10 +1644,19 @@ bool ListEquality(const SlangList* a,const SlangList* b);
 bool VectorEquality(const SlangVec* a,const SlangVec* b);
 bool DictEquality(const SlangDict* a,const SlangDict* b);
 bool StringEquality(const SlangStr* a,const SlangStr* b);
+bool RangeEquality(const SlangIter* a,const SlangIter* b);
+bool PackedEquality(const SlangPacked* a,const SlangPacked* b);
 
 bool EqualObjs(const SlangHeader* a,const SlangHeader* b){
 	if (a==b) return true;
 	if (!a||!b) return false;
+	if (IsImmediate(a)||IsImmediate(b)){
+		// immediates are canonical, so only an int against a real can still match
+		if (GetType(b)==SlangType::Int) std::swap(a,b);
+		if (GetType(a)==SlangType::Int&&GetType(b)==SlangType::Real)
+			return (double)GetInt(a)==GetReal(b);
+		return false;
+	}
 	
 	if (a->type==b->type){
 		switch (a->type){
@@ -1263,15 +1678,20 @@ bool EqualObjs(const SlangHeader* a,const SlangHeader* b){
 				if ((a->flags & FLAG_MAYBE_OCCUPIED) != (b->flags & FLAG_MAYBE_OCCUPIED))
 					return false;
 				return EqualObjs(((SlangObj*)a)->maybe,((SlangObj*)b)->maybe);
+			case SlangType::Iterator:
+				return RangeEquality((SlangIter*)a,(SlangIter*)b);
+			case SlangType::Packed:
+				return PackedEquality((SlangPacked*)a,(SlangPacked*)b);
 			case SlangType::Int:
+				return GetInt(a)==GetInt(b);
 			case SlangType::Real:
+				return std::bit_cast<uint64_t>(GetReal(a))==std::bit_cast<uint64_t>(GetReal(b));
 			case SlangType::Symbol:
-				// union moment
-				return ((SlangObj*)a)->integer==((SlangObj*)b)->integer;
+				return ((SlangObj*)a)->symbol==((SlangObj*)b)->symbol;
 			case SlangType::EndOfFile:
 				return true;
 			case SlangType::Bool:
-				return a->boolVal==b->boolVal;
+				return GetBool(a)==GetBool(b);
 			case SlangType::InputStream:
 			case SlangType::OutputStream:
 				if (a->isFile!=b->isFile)
@@ -1282,13 +1702,21 @@ bool EqualObjs(const SlangHeader* a,const SlangHeader* b){
 	} else {
 		if (b->type==SlangType::Int) std::swap(a,b);
 		if (a->type==SlangType::Int&&b->type==SlangType::Real){
-			return ((double)((SlangObj*)a)->integer)==((SlangObj*)b)->real;
+			return ((double)GetInt(a))==GetReal(b);
 		}
 	}
 	
 	return false;
 }
 
+// ranges are equal when they produce the same ints
+bool RangeEquality(const SlangIter* a,const SlangIter* b){
+	if (a->count!=b->count) return false;
+	if (a->count==0) return true;
+	if (a->pos!=b->pos) return false;
+	return a->count==1||a->step==b->step;
+}
+
 bool ListEquality(const SlangList* a,const SlangList* b){
 	if (!EqualObjs(a->left,b->left)) return false;
 	if (!EqualObjs(a->right,b->right)) return false;
@@ -1297,12 +1725,10 @@ bool ListEquality(const SlangList* a,const SlangList* b){
 }
 
 bool VectorEquality(const SlangVec* a,const SlangVec* b){
-	if (!a->storage || !b->storage){
-		return a->storage == b->storage;
-	}
-	
-	if (a->storage->size!=b->storage->size) return false;
-	for (size_t i=0;i<a->storage->size;++i){
+	// popped or filtered vectors can keep empty storage around
+	size_t size = GetStorageSize(a->storage);
+	if (size!=GetStorageSize(b->storage)) return false;
+	for (size_t i=0;i<size;++i){
 		if (!EqualObjs(a->storage->objs[i],b->storage->objs[i]))
 			return false;
 	}
@@ -1336,6 +1762,15 @@ bool DictEquality(const SlangDict* a,const SlangDict* b){
 	return true;
 }
 
+// reals compare bitwise, same as boxed reals do
+bool PackedEquality(const SlangPacked* a,const SlangPacked* b){
+	if (a->header.packKind!=b->header.packKind) return false;
+	size_t size = a->GetLength();
+	if (size!=b->GetLength()) return false;
+	if (!size) return true;
+	return memcmp(a->storage->data,b->storage->data,size*a->storage->header.elemSize)==0;
+}
+
 bool StringEquality(const SlangStr* a,const SlangStr* b){
 	if (!a->storage || !b->storage){
 		return a->storage == b->storage;
@@ -1354,12 +1789,13 @@ inline bool IdenticalObjs(const SlangHeader* l,const SlangHeader* r){
 		return true;
 	if (!l||!r)
 		return false;
-	if (l->type!=r->type)
+	SlangType type = GetType(l);
+	if (type!=GetType(r))
 		return false;
 	
 	// if both are list type, comparing pointers
 	// alone is enough to determine if l IS r
-	switch (l->type){
+	switch (type){
 		case SlangType::Vector:
 		case SlangType::String:
 		case SlangType::Dict:
@@ -1367,6 +1803,8 @@ inline bool IdenticalObjs(const SlangHeader* l,const SlangHeader* r){
 		case SlangType::NullType:
 		case SlangType::Env:
 		case SlangType::Lambda:
+		case SlangType::Iterator:
+		case SlangType::Packed:
 		case SlangType::Storage:
 		case SlangType::DictTable:
 		case SlangType::InputStream:
@@ -1378,14 +1816,15 @@ inline bool IdenticalObjs(const SlangHeader* l,const SlangHeader* r){
 			}
 			return ((SlangObj*)l)->maybe==((SlangObj*)r)->maybe;
 		case SlangType::Int:
+			return GetInt(l)==GetInt(r);
 		case SlangType::Real:
+			return std::bit_cast<uint64_t>(GetReal(l))==std::bit_cast<uint64_t>(GetReal(r));
 		case SlangType::Symbol:
-			// union moment
-			return ((SlangObj*)l)->integer==((SlangObj*)r)->integer;
+			return ((SlangObj*)l)->symbol==((SlangObj*)r)->symbol;
 		case SlangType::EndOfFile:
 			return true;
 		case SlangType::Bool:
-			return l->boolVal==r->boolVal;
+			return GetBool(l)==GetBool(r);
 	}
 	
 	return false;
@@ -1431,15 +1870,26 @@ void PrintInfo(){
 	std::cout << "Max stack height: " << gMaxStackHeight << '\n';
 	std::cout << "Max arg height: " << gMaxArgHeight << '\n';
 #endif
+	std::cout << "Minor GCs: " << gMinorGCs << '\n';
 	std::cout << "Small GCs: " << gSmallGCs << '\n';
+	if (gGCThreads>1)
+		std::cout << "Parallel GCs: " << gParallelGCs << " (" << gGCThreads << " threads)\n";
 	std::cout << "Realloc count: " << gReallocCount << '\n';
 	std::cout << "Max arena size: " << gMaxArenaSize/1024 << " KB\n";
 	std::cout << "Curr arena size: " << gArenaSize/1024 << " KB\n";
+	MemArena* arena = gDebugInterpreter->arena;
+	std::cout << "Large objects: " << arena->largeObjects.size << " (" << arena->largeSize/1024 << " KB)\n";
 	std::cout << "Case misses: " << gCaseMisses << "\n";
 	size_t caseMem = gDebugInterpreter->codeWriter.caseDictElements.cap*sizeof(CaseDictElement);
 	std::cout << "Case mem: " << caseMem/1024 << " KB\n";
+#ifdef SLANG_JIT
+	std::cout << "JIT blocks: " << gJitBlocks << '\n';
+	std::cout << "JIT code: " << gJitCodeSize/1024 << " KB\n";
+#endif
 	std::cout << std::fixed << std::setprecision(3);
 	std::cout << "Compile time: " << gCompileTime*1000 << "ms\n";
+	std::cout << "GC pause total: " << gGCPauseTotal*1000 << "ms\n";
+	std::cout << "GC pause max: " << gGCPauseMax*1000 << "ms\n";
 	if (gRunTime>=2.0)
 		std::cout << "Run time: " << gRunTime << "s\n";
 	else
@@ -1889,9 +2339,9 @@ inline bool SlangParser::ParseObj(SlangHeader** res){
 			char* d;
 			int64_t i = strtoll(copyArr,&d,10);
 			NextToken();
-			SlangObj* intObj = alloc.MakeInt(i);
-			codeMap[(SlangHeader*)intObj] = loc;
-			*res = (SlangHeader*)intObj;
+			SlangHeader* intObj = alloc.MakeInt(i);
+			codeMap[intObj] = loc;
+			*res = intObj;
 			return true;
 		}
 		case SlangTokenType::Real: {
@@ -1911,9 +2361,9 @@ inline bool SlangParser::ParseObj(SlangHeader** res){
 				PushError("Could not parse real: "+std::string(token.view));
 				return false;
 			}
-			SlangObj* realObj = alloc.MakeReal(r);
-			codeMap[(SlangHeader*)realObj] = loc;
-			*res = (SlangHeader*)realObj;
+			SlangHeader* realObj = alloc.MakeReal(r);
+			codeMap[realObj] = loc;
+			*res = realObj;
 			return true;
 		}
 		case SlangTokenType::Symbol: {
@@ -2317,8 +2767,10 @@ inline void* CodeWriterObjAlloc(void* data,size_t s){
 SlangHeader* CodeWriter::Copy(const SlangHeader* obj){
 	if (!obj)
 		return nullptr;
+	if (IsImmediate(obj))
+		return (SlangHeader*)obj;
 	
-	switch (obj->type){
+	switch (GetType(obj)){
 		case SlangType::Int:
 		case SlangType::Real:
 		case SlangType::Symbol:
@@ -2343,6 +2795,13 @@ SlangHeader* CodeWriter::Copy(const SlangHeader* obj){
 			newMaybe->maybe = Copy(oldMaybe->maybe);
 			return (SlangHeader*)newMaybe;
 		}
+		case SlangType::Iterator: {
+			SlangIter* oldIter = (SlangIter*)obj;
+			SlangIter* newIter = (SlangIter*)alloc.Allocate(obj->GetSize());
+			memcpy(newIter,oldIter,obj->GetSize());
+			newIter->source = Copy(oldIter->source);
+			return (SlangHeader*)newIter;
+		}
 		case SlangType::Vector: {
 			SlangVec* oldVec = (SlangVec*)obj;
 			SlangVec* newVec = (SlangVec*)alloc.Allocate(obj->GetSize());
@@ -2352,6 +2811,19 @@ SlangHeader* CodeWriter::Copy(const SlangHeader* obj){
 			newVec->storage = (SlangStorage*)Copy((SlangHeader*)oldVec->storage);
 			return (SlangHeader*)newVec;
 		}
+		case SlangType::Packed: {
+			SlangPacked* oldPacked = (SlangPacked*)obj;
+			SlangPacked* newPacked = (SlangPacked*)alloc.Allocate(obj->GetSize());
+			memcpy(newPacked,oldPacked,obj->GetSize());
+			if (!oldPacked->storage)
+				return (SlangHeader*)newPacked;
+			// the elements are raw numbers, so the storage is copied as bytes
+			SlangStorage* oldStorage = oldPacked->storage;
+			size_t elemSize = oldStorage->header.elemSize;
+			newPacked->storage = alloc.AllocateStorage(oldStorage->size,elemSize);
+			memcpy(newPacked->storage->data,oldStorage->data,oldStorage->size*elemSize);
+			return (SlangHeader*)newPacked;
+		}
 		case SlangType::String: {
 			SlangStr* oldStr = (SlangStr*)obj;
 			SlangStr* newStr = (SlangStr*)alloc.Allocate(obj->GetSize());
@@ -2447,10 +2919,10 @@ enum SlangOpCodes {
 	SLANG_OP_ZERO,
 	SLANG_OP_ONE,
 	SLANG_OP_PUSH_LAMBDA,
+	SLANG_OP_MAKE_CLOSURE,
 	
 	// variable ops
-	SLANG_OP_LOOKUP,
-	SLANG_OP_SET,
+	SLANG_OP_GET_CAPTURE,
 	SLANG_OP_GET_LOCAL,
 	SLANG_OP_SET_LOCAL,
 	SLANG_OP_GET_GLOBAL,
@@ -2458,11 +2930,13 @@ enum SlangOpCodes {
 	SLANG_OP_DEF_GLOBAL,
 	SLANG_OP_GET_STACK,
 	SLANG_OP_SET_STACK,
+	SLANG_OP_MAKE_BOX,
+	SLANG_OP_UNBOX,
+	SLANG_OP_SET_BOX,
 	
 	// arg manip
 	SLANG_OP_PUSH_FRAME,
 	SLANG_OP_POP_ARG,
-	SLANG_OP_INTERNAL_DEF,
 	SLANG_OP_UNPACK,
 	SLANG_OP_COPY,
 	// functions calls
@@ -2516,11 +2990,58 @@ enum SlangOpCodes {
 	SLANG_OP_EXPORT,
 	SLANG_OP_IMPORT,
 	
+	// superinstructions, only emitted by Optimize
+	SLANG_OP_GET_LOCAL2,
+	SLANG_OP_PUSH_FRAME_LOCAL,
+	SLANG_OP_DEC_LOCAL,
+	SLANG_OP_ADD_LOCALS,
+	SLANG_OP_CJUMP_LOCAL,
+	// register form, operands name frame registers, only emitted
+	// by AllocateRegisters with SLANG_REGISTER_VM
+	SLANG_OP_REG_STORE,
+	SLANG_OP_REG_ADD,
+	SLANG_OP_REG_SUB,
+	SLANG_OP_REG_MUL,
+	SLANG_OP_REG_DIV,
+	SLANG_OP_REG_EQ,
+	SLANG_OP_REG_PAIR,
+	SLANG_OP_REG_NOT,
+	SLANG_OP_REG_INC,
+	SLANG_OP_REG_DEC,
+	SLANG_OP_REG_NEG,
+	SLANG_OP_REG_LEFT,
+	SLANG_OP_REG_RIGHT,
+	SLANG_OP_REG_UNBOX,
+	SLANG_OP_REG_CJUMP,
+	SLANG_OP_REG_CNJUMP,
+	SLANG_OP_REG_RET,
+	// quickened two operand arith, rewritten in place at run time
+	SLANG_OP_ADD_II,
+	SLANG_OP_SUB_II,
+	SLANG_OP_MUL_II,
+	SLANG_OP_DIV_II,
+	SLANG_OP_ADD_RR,
+	SLANG_OP_SUB_RR,
+	SLANG_OP_MUL_RR,
+	SLANG_OP_DIV_RR,
+	// only reached through gJitEnterStub
+	SLANG_OP_JIT_ENTER,
+	
 	SLANG_OP_COUNT
 };
 
 static_assert(SLANG_OP_COUNT<=256);
 
+#ifdef SLANG_JIT
+// pc is backed up onto the op like any other inst before the loop
+// steps forward, the padding keeps that inside the object
+struct JitEnterStub {
+	uint8_t pad[32];
+	uint8_t op;
+};
+static const JitEnterStub gJitEnterStub = {{},SLANG_OP_JIT_ENTER};
+#endif
+
 #define OPCODE_SIZE 1
 static const size_t SlangOpSizes[] = {
 	OPCODE_SIZE,    // SLANG_OP_NOOP
@@ -2532,18 +3053,20 @@ static const size_t SlangOpSizes[] = {
 	OPCODE_SIZE,    // SLANG_OP_ZERO
 	OPCODE_SIZE,    // SLANG_OP_ONE
 	OPCODE_SIZE+8,  // SLANG_OP_PUSH_LAMBDA
-	OPCODE_SIZE+8+4,// SLANG_OP_LOOKUP
-	OPCODE_SIZE+8,  // SLANG_OP_SET
+	OPCODE_SIZE+8,  // SLANG_OP_MAKE_CLOSURE
+	OPCODE_SIZE+2,  // SLANG_OP_GET_CAPTURE
 	OPCODE_SIZE+2,  // SLANG_OP_GET_LOCAL
 	OPCODE_SIZE+2,  // SLANG_OP_SET_LOCAL
-	OPCODE_SIZE+8,  // SLANG_OP_GET_GLOBAL
+	OPCODE_SIZE+20, // SLANG_OP_GET_GLOBAL
 	OPCODE_SIZE+8,  // SLANG_OP_SET_GLOBAL
 	OPCODE_SIZE+8,  // SLANG_OP_DEF_GLOBAL
 	OPCODE_SIZE+4,  // SLANG_OP_GET_STACK
 	OPCODE_SIZE+4,  // SLANG_OP_SET_STACK
+	OPCODE_SIZE,    // SLANG_OP_MAKE_BOX
+	OPCODE_SIZE,    // SLANG_OP_UNBOX
+	OPCODE_SIZE,    // SLANG_OP_SET_BOX
 	OPCODE_SIZE,    // SLANG_OP_PUSH_FRAME
 	OPCODE_SIZE,    // SLANG_OP_POP_ARG
-	OPCODE_SIZE+4,  // SLANG_OP_INTERNAL_DEF
 	OPCODE_SIZE,    // SLANG_OP_UNPACK
 	OPCODE_SIZE,    // SLANG_OP_COPY
 	OPCODE_SIZE,    // SLANG_OP_CALL
@@ -2587,9 +3110,246 @@ static const size_t SlangOpSizes[] = {
 	OPCODE_SIZE,    // SLANG_OP_VEC_SET
 	OPCODE_SIZE+8,  // SLANG_OP_EXPORT
 	OPCODE_SIZE+8,  // SLANG_OP_IMPORT
+	OPCODE_SIZE+4,  // SLANG_OP_GET_LOCAL2
+	OPCODE_SIZE+2,  // SLANG_OP_PUSH_FRAME_LOCAL
+	OPCODE_SIZE+2,  // SLANG_OP_DEC_LOCAL
+	OPCODE_SIZE+4,  // SLANG_OP_ADD_LOCALS
+	OPCODE_SIZE+4+2,// SLANG_OP_CJUMP_LOCAL
+	OPCODE_SIZE+6,  // SLANG_OP_REG_STORE
+	OPCODE_SIZE+6,  // SLANG_OP_REG_ADD
+	OPCODE_SIZE+6,  // SLANG_OP_REG_SUB
+	OPCODE_SIZE+6,  // SLANG_OP_REG_MUL
+	OPCODE_SIZE+6,  // SLANG_OP_REG_DIV
+	OPCODE_SIZE+6,  // SLANG_OP_REG_EQ
+	OPCODE_SIZE+6,  // SLANG_OP_REG_PAIR
+	OPCODE_SIZE+4,  // SLANG_OP_REG_NOT
+	OPCODE_SIZE+4,  // SLANG_OP_REG_INC
+	OPCODE_SIZE+4,  // SLANG_OP_REG_DEC
+	OPCODE_SIZE+4,  // SLANG_OP_REG_NEG
+	OPCODE_SIZE+4,  // SLANG_OP_REG_LEFT
+	OPCODE_SIZE+4,  // SLANG_OP_REG_RIGHT
+	OPCODE_SIZE+4,  // SLANG_OP_REG_UNBOX
+	OPCODE_SIZE+4+4,// SLANG_OP_REG_CJUMP
+	OPCODE_SIZE+4+4,// SLANG_OP_REG_CNJUMP
+	OPCODE_SIZE+2,  // SLANG_OP_REG_RET
+	OPCODE_SIZE+2,  // SLANG_OP_ADD_II
+	OPCODE_SIZE+2,  // SLANG_OP_SUB_II
+	OPCODE_SIZE+2,  // SLANG_OP_MUL_II
+	OPCODE_SIZE+2,  // SLANG_OP_DIV_II
+	OPCODE_SIZE+2,  // SLANG_OP_ADD_RR
+	OPCODE_SIZE+2,  // SLANG_OP_SUB_RR
+	OPCODE_SIZE+2,  // SLANG_OP_MUL_RR
+	OPCODE_SIZE+2,  // SLANG_OP_DIV_RR
+	OPCODE_SIZE,    // SLANG_OP_JIT_ENTER
 };
 static_assert(SL_ARR_LEN(SlangOpSizes)==SLANG_OP_COUNT);	
 
+#ifdef SLANG_PROFILE_OPS
+static const char* SlangOpNames[] = {
+	"NOOP",
+	"HALT",
+	"NULL",
+	"LOAD_PTR",
+	"BOOL_TRUE",
+	"BOOL_FALSE",
+	"ZERO",
+	"ONE",
+	"PUSH_LAMBDA",
+	"MAKE_CLOSURE",
+	"GET_CAPTURE",
+	"GET_LOCAL",
+	"SET_LOCAL",
+	"GET_GLOBAL",
+	"SET_GLOBAL",
+	"DEF_GLOBAL",
+	"GET_STACK",
+	"SET_STACK",
+	"MAKE_BOX",
+	"UNBOX",
+	"SET_BOX",
+	"PUSH_FRAME",
+	"POP_ARG",
+	"UNPACK",
+	"COPY",
+	"CALL",
+	"CALLSYM",
+	"RET",
+	"RETCALL",
+	"RETCALLSYM",
+	"RECURSE",
+	"JUMP",
+	"CJUMP_POP",
+	"CNJUMP_POP",
+	"CJUMP",
+	"CNJUMP",
+	"CASE_JUMP",
+	"TRY",
+	"MAYBE_NULL",
+	"MAYBE_WRAP",
+	"MAYBE_UNWRAP",
+	"MAP_STEP",
+	"FOREACH_STEP",
+	"FILTER_STEP",
+	"FOLD_STEP",
+	"NOT",
+	"INC",
+	"DEC",
+	"NEG",
+	"INVERT",
+	"ADD",
+	"SUB",
+	"MUL",
+	"DIV",
+	"EQ",
+	"PAIR",
+	"LIST_CONCAT",
+	"LEFT",
+	"RIGHT",
+	"SET_LEFT",
+	"SET_RIGHT",
+	"MAKE_VEC",
+	"VEC_GET",
+	"VEC_SET",
+	"EXPORT",
+	"IMPORT",
+	"GET_LOCAL2",
+	"PUSH_FRAME_LOCAL",
+	"DEC_LOCAL",
+	"ADD_LOCALS",
+	"CJUMP_LOCAL",
+	"REG_STORE",
+	"REG_ADD",
+	"REG_SUB",
+	"REG_MUL",
+	"REG_DIV",
+	"REG_EQ",
+	"REG_PAIR",
+	"REG_NOT",
+	"REG_INC",
+	"REG_DEC",
+	"REG_NEG",
+	"REG_LEFT",
+	"REG_RIGHT",
+	"REG_UNBOX",
+	"REG_CJUMP",
+	"REG_CNJUMP",
+	"REG_RET",
+	"ADD_II",
+	"SUB_II",
+	"MUL_II",
+	"DIV_II",
+	"ADD_RR",
+	"SUB_RR",
+	"MUL_RR",
+	"DIV_RR",
+	"JIT_ENTER",
+};
+static_assert(SL_ARR_LEN(SlangOpNames)==SLANG_OP_COUNT);
+
+struct OpProfile {
+	uint64_t counts[SLANG_OP_COUNT];
+	uint64_t cycles[SLANG_OP_COUNT];
+	uint64_t pairs[SLANG_OP_COUNT][SLANG_OP_COUNT];
+};
+
+static OpProfile gOpProfile;
+
+inline uint64_t ReadCycleCounter(){
+#if defined(_WIN32)||defined(__x86_64__)||defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec*1000000000ULL+ts.tv_nsec;
+#endif
+}
+
+struct OpPairCount {
+	uint8_t first;
+	uint8_t second;
+	uint64_t count;
+};
+
+static bool OpCyclesGreater(uint8_t a,uint8_t b){
+	return gOpProfile.cycles[a]>gOpProfile.cycles[b];
+}
+
+static bool OpPairGreater(const OpPairCount& a,const OpPairCount& b){
+	return a.count>b.count;
+}
+
+void PrintOpProfile(){
+	uint64_t totalCount = 0;
+	uint64_t totalCycles = 0;
+	uint8_t order[SLANG_OP_COUNT];
+	for (size_t i=0;i<SLANG_OP_COUNT;++i){
+		order[i] = i;
+		totalCount += gOpProfile.counts[i];
+		totalCycles += gOpProfile.cycles[i];
+	}
+	if (!totalCount){
+		std::cout << "No ops profiled\n";
+		return;
+	}
+	std::sort(order,order+SLANG_OP_COUNT,OpCyclesGreater);
+	
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "\n" << std::left << std::setw(18) << "OP" << std::right;
+	std::cout << std::setw(14) << "COUNT" << std::setw(8) << "%";
+	std::cout << std::setw(16) << "CYCLES" << std::setw(8) << "%";
+	std::cout << std::setw(10) << "CYC/OP" << '\n';
+	for (size_t i=0;i<SLANG_OP_COUNT;++i){
+		uint8_t op = order[i];
+		uint64_t count = gOpProfile.counts[op];
+		if (!count)
+			continue;
+		uint64_t cycles = gOpProfile.cycles[op];
+		std::cout << std::left << std::setw(18) << SlangOpNames[op] << std::right;
+		std::cout << std::setw(14) << count;
+		std::cout << std::setw(8) << 100.0*count/totalCount;
+		std::cout << std::setw(16) << cycles;
+		std::cout << std::setw(8) << 100.0*cycles/(totalCycles ? totalCycles : 1);
+		std::cout << std::setw(10) << (double)cycles/count << '\n';
+	}
+	
+	std::vector<OpPairCount> pairs;
+	for (size_t i=0;i<SLANG_OP_COUNT;++i){
+		for (size_t j=0;j<SLANG_OP_COUNT;++j){
+			if (gOpProfile.pairs[i][j])
+				pairs.push_back({(uint8_t)i,(uint8_t)j,gOpProfile.pairs[i][j]});
+		}
+	}
+	std::sort(pairs.begin(),pairs.end(),OpPairGreater);
+	
+	std::cout << "\n" << std::left << std::setw(36) << "PAIR" << std::right;
+	std::cout << std::setw(14) << "COUNT" << std::setw(8) << "%" << '\n';
+	for (size_t i=0;i<pairs.size()&&i<32;++i){
+		const auto& pair = pairs[i];
+		std::string name = SlangOpNames[pair.first];
+		name += ' ';
+		name += SlangOpNames[pair.second];
+		std::cout << std::left << std::setw(36) << name << std::right;
+		std::cout << std::setw(14) << pair.count;
+		std::cout << std::setw(8) << 100.0*pair.count/totalCount << '\n';
+	}
+}
+
+#define PROFILE_OPS_START() \
+	uint64_t profCycles = ReadCycleCounter();
+// charge the op just finished, c->pc is at the next one
+#define PROFILE_OPS_STEP() \
+	if (gProfileOps){ \
+		uint64_t now = ReadCycleCounter(); \
+		gOpProfile.cycles[op] += now-profCycles; \
+		++gOpProfile.counts[op]; \
+		++gOpProfile.pairs[op][*c->pc]; \
+		profCycles = now; \
+	}
+#else
+#define PROFILE_OPS_START()
+#define PROFILE_OPS_STEP()
+#endif
+
 void CodeWriter::WriteOpCode(uint8_t op){
 	CODE_REALLOC_BLOCK(uint8_t);
 	lastInst = curr->write;
@@ -2677,10 +3437,29 @@ void CodeWriter::WriteMakePair(){
 	--currHeights.Back();
 }
 
+// pushes each captured var's slot, then MAKE_CLOSURE
+// copies them into the new lambda's record
 void CodeWriter::WriteMakeLambda(uint64_t lambdaIndex){
-	WriteOpCode(SLANG_OP_PUSH_LAMBDA);
+	const ParamData& captures = lambdaCodes[lambdaIndex].captures;
+	if (captures.size==0){
+		WriteOpCode(SLANG_OP_PUSH_LAMBDA);
+		WriteInt64(lambdaIndex);
+		++currHeights.Back();
+		return;
+	}
+	
+	for (size_t i=0;i<captures.size;++i){
+		if (i==lambdaCodes[lambdaIndex].selfCapture){
+			WriteNull();
+			continue;
+		}
+		VarRef ref;
+		ResolveVar(captures.data[i],ref);
+		WriteVarRef(ref);
+	}
+	WriteOpCode(SLANG_OP_MAKE_CLOSURE);
 	WriteInt64(lambdaIndex);
-	++currHeights.Back();
+	currHeights.Back() -= captures.size-1;
 }
 
 inline void CodeWriter::WriteInt16(uint16_t i){
@@ -2985,133 +3764,253 @@ inline bool CodeWriter::IsPure(const SlangHeader* expr) const {
 	return true;
 }
 
-bool CodeWriter::SymbolInStarParams(SymbolName sym,uint32_t& height) const {
-	if (lambdaStack.empty()) return false;
-	size_t stackIdx = lambdaStack.size()-1;
-	//size_t accHeight = 0;
-	while (true){
-		const LambdaData& lam = lambdaStack[stackIdx];
-		if (!lam.isStar)
-			return false;
-		for (size_t i=0;i<lam.params.size;++i){
-			SymbolName s = lam.params.data[i];
-			if (sym==s){
-				height = currHeights.Back()-lam.paramHeights.data[i]+1;
-				return true;
-			}
+inline bool ParamsContain(const ParamData& params,SymbolName sym,size_t& idx){
+	for (size_t i=0;i<params.size;++i){
+		if (params.data[i]==sym){
+			idx = i;
+			return true;
 		}
-		if (stackIdx==0)
-			break;
-		--stackIdx;
-		//accHeight += currHeights.Back();
 	}
 	return false;
 }
 
-bool CodeWriter::SymbolInInternalDefs(SymbolName sym,uint32_t& height) const {
-	if (lambdaStack.empty()) return false;
-	const LambdaData& lam = lambdaStack.back();
-	
-	for (size_t i=0;i<lam.defs.size;++i){
-		// if not defined yet
-		if (i>=lam.currInternalDef){
-			return false;
-		}
-		SymbolName s = lam.defs.data[i];
-		if (sym==s){
-			height = currHeights.Back()-(lam.defHeightsStart+i);
-			return true;
-		}
-	}
-	
-	return false;
+// a let's name isn't in scope until its params are inited
+inline bool IsSelfName(const LambdaData& lam,SymbolName sym){
+	return lam.funcName==sym&&!lam.globalName&&!lam.isStar;
 }
 
-bool CodeWriter::SymbolInParams(SymbolName sym,uint16_t& into) const {
-	if (lambdaStack.empty()) return false;
-	size_t index = lambdaStack.size()-1;
-	const LambdaData* lam = &lambdaStack[index];
-	while (lam->isStar){
-		if (index==0) return false;
-		lam = &lambdaStack[--index];
-	}
+inline bool IsLambdaExpr(const SlangHeader* expr){
+	if (GetType(expr)!=SlangType::List)
+		return false;
 	
-	for (size_t i=0;i<lam->params.size;++i){
-		SymbolName s = lam->params.data[i];
-		if (sym==s){
-			into = i;
-			return true;
-		}
-	}
-	return false;
+	const SlangHeader* head = ((SlangList*)expr)->left;
+	return GetType(head)==SlangType::Symbol&&((SlangObj*)head)->symbol==SLANG_LAMBDA;
 }
 
-bool CodeWriter::SymbolNotInAnyParams(SymbolName sym,uint32_t& frameHeight) const {
-	if (lambdaStack.empty()) return true;
-	size_t stackIdx = lambdaStack.size()-1;
-	while (true){
-		const LambdaData& lam = lambdaStack[stackIdx];
-		if (lam.funcName==sym){
-			frameHeight = stackIdx;
-			return false;
+// collects every set! target in expr and every symbol
+// that appears inside a nested lambda, let or letrec
+void ScanVarUses(
+		const SlangHeader* expr,
+		bool nested,
+		std::set<SymbolName>& sets,
+		std::set<SymbolName>& refs){
+	SlangType type = GetType(expr);
+	if (type==SlangType::Symbol){
+		if (nested)
+			refs.insert(((SlangObj*)expr)->symbol);
+		return;
+	} else if (type==SlangType::Vector){
+		const SlangStorage* storage = ((SlangVec*)expr)->storage;
+		if (!storage) return;
+		for (size_t i=0;i<storage->size;++i){
+			ScanVarUses(storage->objs[i],nested,sets,refs);
 		}
-		
-		for (size_t i=0;i<lam.params.size;++i){
-			SymbolName s = lam.params.data[i];
-			if (sym==s){
-				frameHeight = stackIdx;
-				return false;
-			}
+		return;
+	} else if (type!=SlangType::List){
+		return;
+	}
+	
+	const SlangList* list = (SlangList*)expr;
+	if (GetType(list->left)==SlangType::Symbol){
+		SymbolName head = ((SlangObj*)list->left)->symbol;
+		if (head==SLANG_LAMBDA||head==SLANG_LET||head==SLANG_LETREC){
+			nested = true;
+		} else if (head==SLANG_SET&&GetType(list->right)==SlangType::List){
+			const SlangHeader* target = ((SlangList*)list->right)->left;
+			if (GetType(target)==SlangType::Symbol)
+				sets.insert(((SlangObj*)target)->symbol);
 		}
-		for (size_t i=0;i<lam.defs.size;++i){
-			SymbolName s = lam.defs.data[i];
-			if (sym==s){
-				frameHeight = stackIdx;
-				return false;
-			}
+	}
+	
+	while (true){
+		ScanVarUses(list->left,nested,sets,refs);
+		if (GetType(list->right)!=SlangType::List){
+			ScanVarUses(list->right,nested,sets,refs);
+			return;
 		}
-		if (stackIdx==0)
-			break;
-		--stackIdx;
+		list = (SlangList*)list->right;
 	}
-	return true;
 }
 
-bool CodeWriter::ParamIsInited(uint16_t idx) const {
-	if (lambdaStack.empty()) return true;
-	const LambdaData& lam = lambdaStack.back();
-	if (!lam.isLetRec) return true;
-	return idx<lam.currLetInit;
+// captures copy values into the closure, so a var needs a box when a
+// capture could see a later value than the one copied: when it's mutated
+// and used by a nested lambda, or when it's captured before it's inited
+void CodeWriter::MarkBoxedVars(
+		const SlangList* body,
+		const std::vector<SlangHeader*>* initExprs,
+		const std::vector<SlangHeader*>& internalDefs){
+	LambdaData& lam = lambdaStack.back();
+	std::set<SymbolName> sets{};
+	std::set<SymbolName> refs{};
+	if (initExprs){
+		for (size_t i=0;i<initExprs->size();++i){
+			SymbolName param = lam.params.data[i];
+			std::set<SymbolName> exprRefs{};
+			ScanVarUses((*initExprs)[i],false,sets,exprRefs);
+			// a lambda's own name refers to itself
+			if (refs.contains(param)||(!IsLambdaExpr((*initExprs)[i])&&exprRefs.contains(param)))
+				lam.boxed.insert(param);
+			refs.insert(exprRefs.begin(),exprRefs.end());
+		}
+	}
+	
+	for (size_t i=0;i<internalDefs.size();++i){
+		SymbolName def = lam.defs.data[i];
+		std::set<SymbolName> exprRefs{};
+		ScanVarUses(internalDefs[i],false,sets,exprRefs);
+		if (refs.contains(def)||(!IsLambdaExpr(internalDefs[i])&&exprRefs.contains(def)))
+			lam.boxed.insert(def);
+		refs.insert(exprRefs.begin(),exprRefs.end());
+	}
+	
+	ScanVarUses((const SlangHeader*)body,false,sets,refs);
+	for (size_t i=0;i<lam.params.size;++i){
+		SymbolName param = lam.params.data[i];
+		if (sets.contains(param)&&refs.contains(param))
+			lam.boxed.insert(param);
+	}
+	// defs can only be set from nested lambdas
+	for (size_t i=0;i<lam.defs.size;++i){
+		if (sets.contains(lam.defs.data[i]))
+			lam.boxed.insert(lam.defs.data[i]);
+	}
 }
 
-void CodeWriter::AddClosureParam(SymbolName sym){
+// finds where sym lives as seen from the code being written, vars
+// from outer lambdas are added to the current lambda's captures
+void CodeWriter::ResolveVar(SymbolName sym,VarRef& ref){
+	ref.loc = VAR_GLOBAL;
+	ref.boxed = false;
+	ref.selfLevel = -1ULL;
+	ref.defIndex = -1U;
 	if (lambdaStack.empty()) return;
-	size_t stackIdx = lambdaStack.size()-1;
-	while (true){
-		LambdaData& lam = lambdaStack[stackIdx];
-		for (size_t i=0;i<lam.params.size;++i){
-			auto s = lam.params.data[i];
-			if (sym==s){
-				lam.isClosure = true;
-				return;
-			}
+	
+	size_t level = lambdaStack.size()-1;
+	size_t idx;
+	// let params being inited live on the enclosing lambda's stack
+	while (lambdaStack[level].isStar){
+		const LambdaData& lam = lambdaStack[level];
+		if (ParamsContain(lam.params,sym,idx)){
+			ref.loc = VAR_STACK;
+			ref.level = level;
+			ref.index = currHeights.Back()-lam.paramHeights.data[idx]+1;
+			ref.boxed = lam.initBoxed.contains(sym);
+			return;
 		}
-		for (size_t i=0;i<lam.defs.size;++i){
-			auto s = lam.defs.data[i];
-			if (sym==s){
-				lam.isClosure = true;
-				return;
-			}
+		if (level==0) return;
+		--level;
+	}
+	
+	LambdaData& lam = lambdaStack[level];
+	ref.level = level;
+	if (ParamsContain(lam.params,sym,idx)){
+		ref.loc = VAR_LOCAL;
+		ref.index = idx;
+		ref.boxed = lam.boxed.contains(sym);
+	} else if (ParamsContain(lam.defs,sym,idx)){
+		ref.loc = VAR_STACK;
+		ref.index = currHeights.Back()-(lam.defHeightsStart+idx);
+		ref.defIndex = idx;
+		ref.boxed = lam.boxed.contains(sym);
+	} else if (IsSelfName(lam,sym)){
+		ref.loc = VAR_CAPTURE;
+		ref.index = SelfCapture(lam);
+		ref.selfLevel = level;
+	} else if (BoundOutside(sym,level,ref)){
+		ref.loc = VAR_CAPTURE;
+		ref.index = AddCapture(lam,sym);
+	}
+}
+
+bool CodeWriter::BoundOutside(SymbolName sym,size_t level,VarRef& ref) const {
+	size_t idx;
+	while (level>0){
+		const LambdaData& lam = lambdaStack[--level];
+		if (ParamsContain(lam.params,sym,idx)){
+			if (lam.isStar)
+				ref.boxed = lam.initBoxed.contains(sym);
+			else
+				ref.boxed = lam.boxed.contains(sym);
+			return true;
 		}
-		if (stackIdx==0)
+		if (ParamsContain(lam.defs,sym,idx)){
+			ref.boxed = lam.boxed.contains(sym);
+			ref.defIndex = idx;
+			return true;
+		}
+		if (IsSelfName(lam,sym)){
+			ref.selfLevel = level;
+			return true;
+		}
+	}
+	return false;
+}
+
+// level of the lambda that sym names, -1ULL if it's shadowed or global
+size_t CodeWriter::SelfLevelOf(SymbolName sym) const {
+	size_t idx;
+	for (size_t level=lambdaStack.size();level>0;--level){
+		const LambdaData& lam = lambdaStack[level-1];
+		if (ParamsContain(lam.params,sym,idx)||ParamsContain(lam.defs,sym,idx))
+			return -1ULL;
+		if (IsSelfName(lam,sym))
+			return level-1;
+	}
+	return -1ULL;
+}
+
+uint16_t CodeWriter::AddCapture(LambdaData& lam,SymbolName sym){
+	size_t idx;
+	if (ParamsContain(lam.captures,sym,idx))
+		return idx;
+	
+	lam.captures.PushBack(sym);
+	return lam.captures.size-1;
+}
+
+// the closure record holds the lambda itself when its body uses its name
+uint16_t CodeWriter::SelfCapture(LambdaData& lam){
+	if (lam.selfCapture==NO_CAPTURE){
+		lam.selfCapture = lam.captures.size;
+		lam.captures.PushBack(lam.funcName);
+	}
+	return lam.selfCapture;
+}
+
+bool CodeWriter::VarIsInited(const VarRef& ref) const {
+	if (ref.loc==VAR_LOCAL){
+		const LambdaData& lam = lambdaStack[ref.level];
+		return !lam.isLetRec||ref.index<lam.currLetInit;
+	}
+	if (ref.loc==VAR_STACK&&ref.defIndex!=-1U)
+		return ref.defIndex<lambdaStack[ref.level].currInternalDef;
+	return true;
+}
+
+// pushes the var's slot, which holds its box if it's boxed
+void CodeWriter::WriteVarRef(const VarRef& ref){
+	switch (ref.loc){
+		case VAR_STACK:
+			WriteOpCode(SLANG_OP_GET_STACK);
+			WriteInt32(ref.index);
+			break;
+		case VAR_LOCAL:
+			WriteOpCode(SLANG_OP_GET_LOCAL);
+			WriteInt16(ref.index);
+			break;
+		case VAR_CAPTURE:
+			WriteOpCode(SLANG_OP_GET_CAPTURE);
+			WriteInt16(ref.index);
+			break;
+		default:
+			assert(false);
 			break;
-		--stackIdx;
 	}
-	assert(false);
+	++currHeights.Back();
 }
 
 SlangHeader* CodeWriter::MakeIntConst(int64_t i){
-	return (SlangHeader*)alloc.MakeInt(i);
+	return alloc.MakeInt(i);
 }
 
 SlangHeader* CodeWriter::MakeSymbolConst(SymbolName sym){
@@ -3134,6 +4033,11 @@ bool CodeWriter::CompileData(const SlangHeader* obj){
 		curr = &lambdaCodes[evalFuncIndex];
 		curr->write = curr->start;
 		curr->isPure = true;
+#ifdef SLANG_JIT
+		FreeJitCode(curr->jit);
+		curr->jit = nullptr;
+		curr->callCount = 0;
+#endif
 	}
 	curr->moduleIndex = currModuleIndex;
 	InitCompile();
@@ -3142,6 +4046,8 @@ bool CodeWriter::CompileData(const SlangHeader* obj){
 		return false;
 		
 	WriteOpCode(SLANG_OP_HALT);
+	if (optimize)
+		Optimize(*curr,false);
 	
 	return true;
 }
@@ -3171,6 +4077,8 @@ bool CodeWriter::CompileCode(const std::string& code){
 		return false;
 	
 	WriteOpCode(SLANG_OP_HALT);
+	if (optimize)
+		Optimize(*curr,false);
 	gCompileTime = GetDoublePerfTime()-start;
 	return true;
 }
@@ -3201,6 +4109,8 @@ bool CodeWriter::CompileModule(ModuleName name,const std::string& code,size_t& f
 		return false;
 	
 	WriteOpCode(SLANG_OP_HALT);
+	if (optimize)
+		Optimize(*curr,false);
 	return true;
 }
 
@@ -3242,29 +4152,28 @@ bool CodeWriter::CompileDefine(const SlangHeader* head){
 		currSetName = EMPTY_NAME;
 	
 	if (defType==SLANG_SET){
-		uint16_t p;
-		uint32_t height;
-		uint32_t frameHeight;
-		if (SymbolInStarParams(sym,height)){
-			WriteOpCode(SLANG_OP_SET_STACK);
-			WriteInt32(height);
+		VarRef ref;
+		ResolveVar(sym,ref);
+		if (ref.loc==VAR_GLOBAL){
+			WriteOpCode(SLANG_OP_SET_GLOBAL);
+			WriteSymbolName(sym);
 			--currHeights.Back();
-		} else if (SymbolInInternalDefs(sym,height)){
+		} else if ((ref.defIndex!=-1U&&ref.loc!=VAR_CAPTURE)||ref.selfLevel!=-1ULL){
 			PushError(head,"SetError","Cannot set internal definition!");
 			return false;
-		} else if (SymbolInParams(sym,p)){
-			WriteOpCode(SLANG_OP_SET_LOCAL);
-			WriteInt16(p);
-			--currHeights.Back();
-		} else if (SymbolNotInAnyParams(sym,frameHeight)){
-			WriteOpCode(SLANG_OP_SET_GLOBAL);
-			WriteSymbolName(sym);
+		} else if (ref.boxed){
+			WriteVarRef(ref);
+			WriteOpCode(SLANG_OP_SET_BOX);
+			currHeights.Back() -= 2;
+		} else if (ref.loc==VAR_STACK){
+			WriteOpCode(SLANG_OP_SET_STACK);
+			WriteInt32(ref.index);
 			--currHeights.Back();
 		} else {
-			// closure set
-			WriteOpCode(SLANG_OP_SET);
-			WriteSymbolName(sym);
-			AddClosureParam(sym);
+			// set! targets that are captured are always boxed
+			assert(ref.loc==VAR_LOCAL);
+			WriteOpCode(SLANG_OP_SET_LOCAL);
+			WriteInt16(ref.index);
 			--currHeights.Back();
 		}
 	} else {
@@ -3277,6 +4186,34 @@ bool CodeWriter::CompileDefine(const SlangHeader* head){
 	return true;
 }
 
+// a range only walked by map, foreach, filter or fold can't escape,
+// so its ints are made as they're needed instead of built as a list
+bool CodeWriter::CompileIterable(const SlangHeader* expr){
+	if (GetType(expr)!=SlangType::List)
+		return CompileExpr(expr);
+	
+	SlangList* list = (SlangList*)expr;
+	if (GetType(list->left)!=SlangType::Symbol||
+			((SlangObj*)list->left)->symbol!=SLANG_RANGE||IsDotted(list))
+		return CompileExpr(expr);
+	
+	size_t argCount = GetArgCount(list)-1;
+	if (!GoodArity(SLANG_LAZY_RANGE,argCount))
+		return CompileExpr(expr);
+	
+	WritePushFrame();
+	SlangList* argIt = (SlangList*)list->right;
+	while (argIt){
+		if (!CompileExpr(argIt->left))
+			return false;
+		argIt = (SlangList*)argIt->right;
+	}
+	
+	WriteCallSym(SLANG_LAZY_RANGE);
+	AddCodeLocation(expr);
+	return true;
+}
+
 bool CodeWriter::CompileMap(const SlangHeader* expr){
 	SlangList* argIt = (SlangList*)((SlangList*)expr)->right;
 	SlangHeader* func = argIt->left;
@@ -3287,7 +4224,7 @@ bool CodeWriter::CompileMap(const SlangHeader* expr){
 	
 	WritePushFrame();
 	
-	if (func->type==SlangType::Symbol){
+	if (GetType(func)==SlangType::Symbol){
 		SymbolName sym = ((SlangObj*)func)->symbol;
 		
 		if (sym<GLOBAL_SYMBOL_COUNT){
@@ -3297,7 +4234,7 @@ bool CodeWriter::CompileMap(const SlangHeader* expr){
 			argIt = (SlangList*)argIt->right;
 			size_t argCount = 0;
 			while (argIt){
-				if (!CompileExpr(argIt->left))
+				if (!CompileIterable(argIt->left))
 					return false;
 				argIt = (SlangList*)argIt->right;
 				++argCount;
@@ -3316,7 +4253,7 @@ bool CodeWriter::CompileMap(const SlangHeader* expr){
 	argIt = (SlangList*)argIt->right;
 	size_t argCount = 0;
 	while (argIt){
-		if (!CompileExpr(argIt->left))
+		if (!CompileIterable(argIt->left))
 			return false;
 		argIt = (SlangList*)argIt->right;
 		++argCount;
@@ -3348,7 +4285,7 @@ bool CodeWriter::CompileForeach(const SlangHeader* expr){
 	
 	WritePushFrame();
 	
-	if (func->type==SlangType::Symbol){
+	if (GetType(func)==SlangType::Symbol){
 		SymbolName sym = ((SlangObj*)func)->symbol;
 		
 		if (sym<GLOBAL_SYMBOL_COUNT){
@@ -3358,7 +4295,7 @@ bool CodeWriter::CompileForeach(const SlangHeader* expr){
 			argIt = (SlangList*)argIt->right;
 			size_t argCount = 0;
 			while (argIt){
-				if (!CompileExpr(argIt->left))
+				if (!CompileIterable(argIt->left))
 					return false;
 				argIt = (SlangList*)argIt->right;
 				++argCount;
@@ -3377,7 +4314,7 @@ bool CodeWriter::CompileForeach(const SlangHeader* expr){
 	argIt = (SlangList*)argIt->right;
 	size_t argCount = 0;
 	while (argIt){
-		if (!CompileExpr(argIt->left))
+		if (!CompileIterable(argIt->left))
 			return false;
 		argIt = (SlangList*)argIt->right;
 		++argCount;
@@ -3405,7 +4342,7 @@ bool CodeWriter::CompileFilter(const SlangHeader* expr){
 	
 	WritePushFrame();
 	
-	if (func->type==SlangType::Symbol){
+	if (GetType(func)==SlangType::Symbol){
 		SymbolName sym = ((SlangObj*)func)->symbol;
 		
 		if (sym<GLOBAL_SYMBOL_COUNT){
@@ -3414,7 +4351,7 @@ bool CodeWriter::CompileFilter(const SlangHeader* expr){
 			
 			argIt = (SlangList*)argIt->right;
 			
-			if (!CompileExpr(argIt->left))
+			if (!CompileIterable(argIt->left))
 				return false;
 			argIt = (SlangList*)argIt->right;
 			
@@ -3430,7 +4367,7 @@ bool CodeWriter::CompileFilter(const SlangHeader* expr){
 		
 	argIt = (SlangList*)argIt->right;
 	
-	if (!CompileExpr(argIt->left))
+	if (!CompileIterable(argIt->left))
 		return false;
 	
 	if (!CompileExpr(func))
@@ -3439,6 +4376,8 @@ bool CodeWriter::CompileFilter(const SlangHeader* expr){
 	// where return list will be stored
 	WriteNull();
 	WriteNull();
+	// item being tested
+	WriteNull();
 	
 	WriteOpCode(SLANG_OP_FILTER_STEP);
 	currHeights.Back() = currFrames.Back()+1;
@@ -3459,7 +4398,7 @@ bool CodeWriter::CompileFold(const SlangHeader* expr){
 	argIt = (SlangList*)argIt->right;
 	WritePushFrame();
 	
-	if (func->type==SlangType::Symbol){
+	if (GetType(func)==SlangType::Symbol){
 		SymbolName sym = ((SlangObj*)func)->symbol;
 		
 		if (sym<GLOBAL_SYMBOL_COUNT){
@@ -3472,7 +4411,7 @@ bool CodeWriter::CompileFold(const SlangHeader* expr){
 			argIt = (SlangList*)argIt->right;
 			
 			// compile list arg
-			if (!CompileExpr(argIt->left))
+			if (!CompileIterable(argIt->left))
 				return false;
 			
 			if (!GoodArity(sym,2)){
@@ -3491,7 +4430,7 @@ bool CodeWriter::CompileFold(const SlangHeader* expr){
 	argIt = (SlangList*)argIt->right;
 	
 	// compile list arg
-	if (!CompileExpr(argIt->left))
+	if (!CompileIterable(argIt->left))
 		return false;
 	
 	if (!CompileExpr(func))
@@ -3570,6 +4509,29 @@ bool CodeWriter::CompileLambdaBody(
 	
 	knownLambdaStack.emplace_back();
 	
+	{
+		const LambdaData& lam = lambdaStack.back();
+		for (size_t i=0;i<lam.params.size;++i){
+			SymbolName param = lam.params.data[i];
+			if (!lam.boxed.contains(param)||lam.initBoxed.contains(param))
+				continue;
+			WriteOpCode(SLANG_OP_GET_LOCAL);
+			WriteInt16(i);
+			WriteOpCode(SLANG_OP_MAKE_BOX);
+			WriteOpCode(SLANG_OP_SET_LOCAL);
+			WriteInt16(i);
+		}
+	}
+	
+	// internal def slots are reserved up front so
+	// closures made before a def runs can take its box
+	lambdaStack.back().defHeightsStart = currHeights.Back();
+	for (size_t i=0;i<lambdaStack.back().defs.size;++i){
+		WriteNull();
+		if (lambdaStack.back().boxed.contains(lambdaStack.back().defs.data[i]))
+			WriteOpCode(SLANG_OP_MAKE_BOX);
+	}
+	
 	if (initExprs){
 		size_t oldDefName = currDefName;
 		size_t argIndex = 0;
@@ -3581,8 +4543,14 @@ bool CodeWriter::CompileLambdaBody(
 			currDefName = param;
 			if (!CompileExpr(expr))
 				return false;
-			WriteOpCode(SLANG_OP_SET_LOCAL);
-			WriteInt16(argIndex++);
+			if (lambdaStack.back().boxed.contains(param)){
+				WriteOpCode(SLANG_OP_GET_LOCAL);
+				WriteInt16(argIndex++);
+				WriteOpCode(SLANG_OP_SET_BOX);
+			} else {
+				WriteOpCode(SLANG_OP_SET_LOCAL);
+				WriteInt16(argIndex++);
+			}
 			--currHeights.Back();
 		}
 		currDefName = oldDefName;
@@ -3592,7 +4560,6 @@ bool CodeWriter::CompileLambdaBody(
 	if (internalDefs){
 		size_t oldDefName = currDefName;
 		size_t argIndex = 0;
-		lambdaStack.back().defHeightsStart = currHeights.Back();
 		for (const auto* expr : *internalDefs){
 			SymbolName internalDefName = lambdaStack.back().defs.data[argIndex];
 			lambdaStack.back().currInternalDef = argIndex;
@@ -3601,8 +4568,16 @@ bool CodeWriter::CompileLambdaBody(
 			currDefName = internalDefName;
 			if (!CompileExpr(expr))
 				return false;
-			WriteOpCode(SLANG_OP_INTERNAL_DEF);
-			WriteInt32(argIndex++);
+			uint32_t height = currHeights.Back()-(lambdaStack.back().defHeightsStart+argIndex++);
+			if (lambdaStack.back().boxed.contains(internalDefName)){
+				WriteOpCode(SLANG_OP_GET_STACK);
+				WriteInt32(height);
+				WriteOpCode(SLANG_OP_SET_BOX);
+			} else {
+				WriteOpCode(SLANG_OP_SET_STACK);
+				WriteInt32(height);
+			}
+			--currHeights.Back();
 		}
 		currDefName = oldDefName;
 		lambdaStack.back().currInternalDef = argIndex;
@@ -3636,7 +4611,11 @@ bool CodeWriter::CompileLambdaBody(
 		}
 	}
 	
-	curr->isClosure = lambdaStack.back().isClosure;
+	curr->captures = lambdaStack.back().captures;
+	curr->selfCapture = lambdaStack.back().selfCapture;
+	curr->isClosure = curr->captures.size!=0;
+	if (optimize)
+		Optimize(*curr,true);
 	
 	curr = &lambdaCodes[savedCurrOffset];
 	lastInst = savedLastInst;
@@ -3660,8 +4639,8 @@ bool IsInternalDef(const SlangHeader* expr){
 
 bool CodeWriter::CompileLambda(const SlangHeader* head){
 	SlangHeader* args = ((SlangList*)head)->right;
-	if (args->type!=SlangType::List){
-		TypeError(args,args->type,SlangType::List);
+	if (GetType(args)!=SlangType::List){
+		TypeError(args,GetType(args),SlangType::List);
 		return false;
 	}
 	SlangList* argIt = (SlangList*)args;
@@ -3679,18 +4658,18 @@ bool CodeWriter::CompileLambda(const SlangHeader* head){
 	SlangList* paramIt = (SlangList*)argIt->left;
 	SlangObj* symObj;
 	while (paramIt){
-		if (paramIt->header.type==SlangType::Symbol){
+		if (GetType((SlangHeader*)paramIt)==SlangType::Symbol){
 			// last variadic arg
 			variadic = true;
 			symObj = (SlangObj*)paramIt;
-		} else if (paramIt->header.type==SlangType::List){
+		} else if (GetType((SlangHeader*)paramIt)==SlangType::List){
 			if (GetType(paramIt->left)!=SlangType::Symbol){
 				TypeError(paramIt->left,GetType(paramIt->left),SlangType::Symbol);
 				return false;
 			}
 			symObj = (SlangObj*)paramIt->left;
 		} else {
-			TypeError((SlangHeader*)paramIt,paramIt->header.type,SlangType::List);
+			TypeError((SlangHeader*)paramIt,GetType((SlangHeader*)paramIt),SlangType::List);
 			return false;
 		}
 		
@@ -3711,6 +4690,7 @@ bool CodeWriter::CompileLambda(const SlangHeader* head){
 	{
 		LambdaData dat{currDefName,params,{},{}};
 		dat.isVariadic = variadic;
+		dat.globalName = lambdaStack.empty();
 		lambdaStack.push_back(dat);
 	}
 	currDefName = EMPTY_NAME;
@@ -3719,6 +4699,7 @@ bool CodeWriter::CompileLambda(const SlangHeader* head){
 	internalDefs.reserve(4);
 	if (!GetInternalDefs(argIt,seen,internalDefs))
 		return false;
+	MarkBoxedVars(argIt,nullptr,internalDefs);
 	
 	if (!CompileLambdaBody(argIt,nullptr,&internalDefs,lambdaIndex))
 		return false;
@@ -3804,7 +4785,7 @@ bool CodeWriter::CompileIf(const SlangHeader* head,bool terminating){
 bool ObjIsFalse(const SlangHeader* expr){
 	if (GetType(expr)!=SlangType::Bool)
 		return false;
-	return expr->boolVal==false;
+	return !GetBool(expr);
 }
 
 bool ObjIsElse(const SlangHeader* expr){
@@ -4238,6 +5219,7 @@ bool CodeWriter::CompileLetRec(const SlangHeader* expr,bool terminating){
 	internalDefs.reserve(4);
 	if (!GetInternalDefs(argIt,seen,internalDefs))
 		return false;
+	MarkBoxedVars(argIt,&initExprs,internalDefs);
 	
 	size_t lamIndex;
 	if (!CompileLambdaBody(argIt,&initExprs,&internalDefs,lamIndex))
@@ -4272,10 +5254,16 @@ bool CodeWriter::CompileLet(const SlangHeader* expr,bool terminating){
 		heights.Reserve(4);
 		LambdaData dat{letName,p,{},heights};
 		dat.isStar = true;
-		dat.isClosure = true;
 		lambdaStack.push_back(dat);
 	}
 	std::set<SymbolName> seen{};
+	// params captured while inits are still running are
+	// boxed as they're inited, so it needs the whole let
+	std::set<SymbolName> sets{};
+	std::set<SymbolName> refs{};
+	std::set<SymbolName> initRefs{};
+	ScanVarUses(params,false,sets,initRefs);
+	ScanVarUses(argIt->right,false,sets,refs);
 	
 	WritePushFrame();
 	while (paramIt){
@@ -4304,6 +5292,12 @@ bool CodeWriter::CompileLet(const SlangHeader* expr,bool terminating){
 		if (!CompileExpr(val))
 			return false;
 		
+		if (sets.contains(sym)&&(refs.contains(sym)||initRefs.contains(sym)))
+			lambdaStack.back().boxed.insert(sym);
+		if (sets.contains(sym)&&initRefs.contains(sym)){
+			lambdaStack.back().initBoxed.insert(sym);
+			WriteOpCode(SLANG_OP_MAKE_BOX);
+		}
 		lambdaStack.back().params.PushBack(sym);
 		lambdaStack.back().paramHeights.PushBack(currHeights.Back());
 		seen.insert(sym);
@@ -4323,6 +5317,7 @@ bool CodeWriter::CompileLet(const SlangHeader* expr,bool terminating){
 	internalDefs.reserve(4);
 	if (!GetInternalDefs(argIt,seen,internalDefs))
 		return false;
+	MarkBoxedVars(argIt,nullptr,internalDefs);
 	
 	knownLambdaStack.emplace_back();
 	if (!CompileLambdaBody(argIt,nullptr,&internalDefs,lamIndex))
@@ -4445,9 +5440,9 @@ bool CodeWriter::CompileConst(const SlangHeader* obj){
 			WriteNull();
 			break;
 		case SlangType::Int:
-			if (asObj->integer==0){
+			if (GetInt(obj)==0){
 				WriteZero();
-			} else if (asObj->integer==1){
+			} else if (GetInt(obj)==1){
 				WriteOne();
 			} else {
 				WriteLoadPtr(Copy(obj));
@@ -4457,7 +5452,7 @@ bool CodeWriter::CompileConst(const SlangHeader* obj){
 			WriteLoadPtr(Copy(obj));
 			break;
 		case SlangType::Bool:
-			if (obj->boolVal)
+			if (GetBool(obj))
 				WriteTrue();
 			else
 				WriteFalse();
@@ -4470,46 +5465,37 @@ bool CodeWriter::CompileConst(const SlangHeader* obj){
 			break;
 		case SlangType::Symbol:
 			sym = asObj->symbol;
-			uint16_t idx;
-			uint32_t height;
-			uint32_t frameHeight;
-			if (SymbolInStarParams(sym,height)){
-				// let local var
-				WriteOpCode(SLANG_OP_GET_STACK);
-				WriteInt32(height);
-				++currHeights.Back();
-			} else if (SymbolInInternalDefs(sym,height)){
-				WriteOpCode(SLANG_OP_GET_STACK);
-				WriteInt32(height);
-				++currHeights.Back();
-			} else if (SymbolInParams(sym,idx)){
-				// local var
-				if (!ParamIsInited(idx)){
-					LetRecError(obj,sym);
-					return false;
-				}
-				WriteOpCode(SLANG_OP_GET_LOCAL);
-				WriteInt16(idx);
-				++currHeights.Back();
-			} else if (SymbolNotInAnyParams(sym,frameHeight)){
-				// global var
+			VarRef ref;
+			ResolveVar(sym,ref);
+			if (ref.loc==VAR_GLOBAL){
 				if (sym>=GLOBAL_SYMBOL_COUNT){
 					WriteOpCode(SLANG_OP_GET_GLOBAL);
 					WriteSymbolName(sym);
+					// inline cache: mapping and epoch
+					WritePointer(nullptr);
+					WriteInt32(0);
 					++currHeights.Back();
 					AddCodeLocation(obj);
 				} else {
 					WriteLoadPtr(Copy(obj));
 				}
-			} else {
-				// closure var
-				WriteOpCode(SLANG_OP_LOOKUP);
-				WriteSymbolName(sym);
-				WriteInt32(frameHeight+1);
-				AddClosureParam(sym);
-				AddCodeLocation(obj);
-				++currHeights.Back();
+				break;
+			}
+			
+			if (!VarIsInited(ref)){
+				LetRecError(obj,sym);
+				return false;
+			}
+			// its callers box those args, see CompileExpr
+			if (ref.selfLevel!=-1ULL&&!lambdaStack[ref.selfLevel].initBoxed.empty()){
+				PushError(obj,"LetError",
+					"Named let can only be called directly when its inits capture a param it sets!"
+				);
+				return false;
 			}
+			WriteVarRef(ref);
+			if (ref.boxed)
+				WriteOpCode(SLANG_OP_UNBOX);
 			break;
 		default:
 			return false;
@@ -5041,84 +6027,910 @@ bool CodeWriter::CompileImport(const SlangHeader* expr){
 	return true;
 }
 
-bool CodeWriter::KnownLambdaArityCheck(const SlangHeader* expr,SymbolName sym,size_t argCount){
-	for (size_t i=knownLambdaStack.size()-1;i!=-1ULL;--i){
-		const auto& layer = knownLambdaStack[i];
-		if (layer.contains(sym)){
-			const CodeBlock& block = lambdaCodes[layer.at(sym)];
-			size_t pCount = block.params.size;
-			if (block.isVariadic){
-				if (argCount<(size_t)(pCount-1)){
-					ArityError(expr,argCount,pCount-1,VARIADIC_ARG_COUNT);
-					return false;
-				}
-			} else {
-				if (argCount!=pCount){
-					ArityError(expr,argCount,pCount,pCount);
-					return false;
-				}
-			}
+struct PeepholeInst {
+	uint32_t offset;
+	uint32_t target;
+	// local operands of a superinstruction, or
+	// the register operands of a register form inst
+	uint16_t operands[3];
+	uint8_t op;
+	bool dead;
+};
+
+inline bool IsJumpOp(uint8_t op){
+	switch (op){
+		case SLANG_OP_JUMP:
+		case SLANG_OP_CJUMP_POP:
+		case SLANG_OP_CNJUMP_POP:
+		case SLANG_OP_CJUMP:
+		case SLANG_OP_CNJUMP:
+		case SLANG_OP_TRY:
+		case SLANG_OP_CJUMP_LOCAL:
+		case SLANG_OP_REG_CJUMP:
+		case SLANG_OP_REG_CNJUMP:
 			return true;
-		}
 	}
-	return true;
+	return false;
 }
 
-#define COMPILE_GLOBAL_SYM(func) \
-	if (!func(expr)) \
-		return false; \
-	if (terminating) \
-		WriteRet(); \
-	AddCodeLocation(expr); \
-	return true
-
-bool CodeWriter::CompileExpr(const SlangHeader* expr,bool terminating){
-	if (GetType(expr)!=SlangType::List){
-		if (!CompileConst(expr))
-			return false;
-		if (terminating){
-			WriteRet();
-		}
-		return true;
+// control never falls through to the next inst
+inline bool IsTerminalOp(uint8_t op){
+	switch (op){
+		case SLANG_OP_HALT:
+		case SLANG_OP_RET:
+		case SLANG_OP_REG_RET:
+		case SLANG_OP_RETCALL:
+		case SLANG_OP_RETCALLSYM:
+		case SLANG_OP_RECURSE:
+		case SLANG_OP_JUMP:
+		case SLANG_OP_CASE_JUMP:
+			return true;
 	}
-	bool recurse = false;
-	
-	SlangList* list = (SlangList*)expr;
-	
-	SlangHeader* head = list->left;
-	SlangType t = GetType(head);
-	if (t!=SlangType::Symbol&&t!=SlangType::List){
-		TypeError(expr,t,SlangType::Lambda);
-		return false;
+	return false;
+}
+
+// pushes with no side effects, can be dropped with a following pop
+inline bool IsPlainPushOp(uint8_t op){
+	switch (op){
+		case SLANG_OP_NULL:
+		case SLANG_OP_LOAD_PTR:
+		case SLANG_OP_BOOL_TRUE:
+		case SLANG_OP_BOOL_FALSE:
+		case SLANG_OP_ZERO:
+		case SLANG_OP_ONE:
+		case SLANG_OP_PUSH_LAMBDA:
+		case SLANG_OP_GET_LOCAL:
+		case SLANG_OP_GET_CAPTURE:
+			return true;
 	}
-	
-	if (IsDotted(list)){
-		DotError((SlangHeader*)list);
-		return false;
+	return false;
+}
+
+struct PeepholeCaseTarget {
+	uint32_t caseInst;
+	uint32_t target;
+};
+
+inline size_t NextLiveInst(const Vector<PeepholeInst>& insts,size_t i){
+	while (insts.data[i].dead)
+		++i;
+	return i;
+}
+
+inline void MarkJumpTargets(
+		const Vector<PeepholeInst>& insts,
+		const Vector<PeepholeCaseTarget>& caseTargets,
+		Vector<uint8_t>& isTarget){
+	memset(isTarget.data,0,isTarget.size);
+	for (size_t i=0;i<insts.size;++i){
+		const PeepholeInst& inst = insts.data[i];
+		if (!inst.dead&&IsJumpOp(inst.op))
+			isTarget.data[NextLiveInst(insts,inst.target)] = true;
+	}
+	for (size_t i=0;i<caseTargets.size;++i){
+		if (!insts.data[caseTargets.data[i].caseInst].dead)
+			isTarget.data[NextLiveInst(insts,caseTargets.data[i].target)] = true;
+	}
+}
+
+inline uint16_t InstLocal(const uint8_t* code,const PeepholeInst& inst){
+	return *(uint16_t*)(code+inst.offset+OPCODE_SIZE);
+}
+
+// superinstruction starting at i, or NOOP
+inline uint8_t FusedOpAt(
+		const uint8_t* code,
+		const Vector<PeepholeInst>& insts,
+		const Vector<uint8_t>& isTarget,
+		size_t i,
+		bool allowPair){
+	size_t count = insts.size-1;
+	uint8_t op = insts.data[i].op;
+	if (op!=SLANG_OP_PUSH_FRAME&&op!=SLANG_OP_GET_LOCAL)
+		return SLANG_OP_NOOP;
+	size_t j = NextLiveInst(insts,i+1);
+	if (j==count||isTarget.data[j])
+		return SLANG_OP_NOOP;
+	uint8_t nextOp = insts.data[j].op;
+	
+	if (op==SLANG_OP_PUSH_FRAME)
+		return (nextOp==SLANG_OP_GET_LOCAL) ? SLANG_OP_PUSH_FRAME_LOCAL : SLANG_OP_NOOP;
+	
+	if (nextOp==SLANG_OP_DEC)
+		return SLANG_OP_DEC_LOCAL;
+	if (nextOp==SLANG_OP_CJUMP_POP)
+		return SLANG_OP_CJUMP_LOCAL;
+	if (nextOp!=SLANG_OP_GET_LOCAL)
+		return SLANG_OP_NOOP;
+	
+	size_t k = NextLiveInst(insts,j+1);
+	if (k!=count&&!isTarget.data[k]&&insts.data[k].op==SLANG_OP_ADD&&
+			InstLocal(code,insts.data[k])==2)
+		return SLANG_OP_ADD_LOCALS;
+	// leave the second local for a better fusion
+	if (!allowPair||FusedOpAt(code,insts,isTarget,j,false)!=SLANG_OP_NOOP)
+		return SLANG_OP_NOOP;
+	return SLANG_OP_GET_LOCAL2;
+}
+
+#ifdef SLANG_REGISTER_VM
+// stack height and open frame starts, -1 past an UNPACK
+struct RegisterState {
+	int32_t height;
+	std::vector<int32_t> frames;
+};
+
+inline bool MergeRegisterState(
+		std::vector<RegisterState>& entry,
+		std::vector<uint8_t>& entered,
+		size_t at,
+		const RegisterState& state){
+	if (!entered[at]){
+		entry[at] = state;
+		entered[at] = true;
+		return true;
 	}
-	
-	size_t argCount = GetArgCount(list)-1;
-	bool inlineSymHead = false;
-	
-	if (t==SlangType::Symbol){
-		SymbolName sym = ((SlangObj*)head)->symbol;
-		if (sym<GLOBAL_SYMBOL_COUNT){
-			if (!GoodArity(sym,argCount)){
-				ArityError(head,argCount,gGlobalArityArray[sym].min,gGlobalArityArray[sym].max);
-				return false;
-			}
-			inlineSymHead = true;
-			// special cases (def, &, ...)
-			switch (sym){
-				case SLANG_DEFINE:
-				case SLANG_SET:
-					COMPILE_GLOBAL_SYM(CompileDefine);
-				case SLANG_DO:
-					return CompileDo(expr,terminating);
-				case SLANG_IF:
-					return CompileIf(expr,terminating);
-				case SLANG_COND:
-					return CompileCond(expr,terminating);
+	return entry[at].height==state.height&&entry[at].frames==state.frames;
+}
+
+// args popped and pushed by an inst that neither
+// closes a frame nor jumps, false if it isn't known
+inline bool RegisterStackEffect(
+		const uint8_t* code,
+		const PeepholeInst& inst,
+		const std::vector<CodeBlock>& lambdaCodes,
+		int32_t& pops,
+		int32_t& pushes){
+	pops = 0;
+	pushes = 1;
+	switch (inst.op){
+		case SLANG_OP_NULL:
+		case SLANG_OP_LOAD_PTR:
+		case SLANG_OP_BOOL_TRUE:
+		case SLANG_OP_BOOL_FALSE:
+		case SLANG_OP_ZERO:
+		case SLANG_OP_ONE:
+		case SLANG_OP_PUSH_LAMBDA:
+		case SLANG_OP_GET_CAPTURE:
+		case SLANG_OP_GET_GLOBAL:
+		case SLANG_OP_GET_LOCAL:
+		case SLANG_OP_GET_STACK:
+		case SLANG_OP_MAYBE_NULL:
+			return true;
+		case SLANG_OP_MAKE_CLOSURE:
+			pops = lambdaCodes[*(uint64_t*)(code+inst.offset+OPCODE_SIZE)].captures.size;
+			return true;
+		case SLANG_OP_MAKE_BOX:
+		case SLANG_OP_UNBOX:
+		case SLANG_OP_COPY:
+		case SLANG_OP_NOT:
+		case SLANG_OP_INC:
+		case SLANG_OP_DEC:
+		case SLANG_OP_NEG:
+		case SLANG_OP_INVERT:
+		case SLANG_OP_LEFT:
+		case SLANG_OP_RIGHT:
+		case SLANG_OP_MAYBE_WRAP:
+		case SLANG_OP_MAYBE_UNWRAP:
+			pops = 1;
+			return true;
+		case SLANG_OP_EQ:
+		case SLANG_OP_PAIR:
+		case SLANG_OP_VEC_GET:
+			pops = 2;
+			return true;
+		case SLANG_OP_ADD:
+		case SLANG_OP_SUB:
+		case SLANG_OP_MUL:
+		case SLANG_OP_DIV:
+		case SLANG_OP_LIST_CONCAT:
+			pops = InstLocal(code,inst);
+			return true;
+		case SLANG_OP_SET_LOCAL:
+		case SLANG_OP_SET_STACK:
+		case SLANG_OP_SET_GLOBAL:
+		case SLANG_OP_DEF_GLOBAL:
+		case SLANG_OP_POP_ARG:
+			pops = 1;
+			pushes = 0;
+			return true;
+		case SLANG_OP_SET_BOX:
+		case SLANG_OP_SET_LEFT:
+		case SLANG_OP_SET_RIGHT:
+			pops = 2;
+			pushes = 0;
+			return true;
+		case SLANG_OP_VEC_SET:
+			pops = 3;
+			pushes = 0;
+			return true;
+		case SLANG_OP_NOOP:
+		case SLANG_OP_EXPORT:
+		case SLANG_OP_IMPORT:
+			pushes = 0;
+			return true;
+	}
+	return false;
+}
+
+// register form of a stack inst and how many of the top
+// args it reads, NOOP if it has none
+inline uint8_t RegisterFormOp(const uint8_t* code,const PeepholeInst& inst,int32_t& count){
+	count = 1;
+	switch (inst.op){
+		case SLANG_OP_ADD:
+		case SLANG_OP_SUB:
+		case SLANG_OP_MUL:
+		case SLANG_OP_DIV:
+			count = 2;
+			if (InstLocal(code,inst)!=2)
+				return SLANG_OP_NOOP;
+			return inst.op-SLANG_OP_ADD+SLANG_OP_REG_ADD;
+		case SLANG_OP_EQ:
+			count = 2;
+			return SLANG_OP_REG_EQ;
+		case SLANG_OP_PAIR:
+			count = 2;
+			return SLANG_OP_REG_PAIR;
+		case SLANG_OP_NOT:
+			return SLANG_OP_REG_NOT;
+		case SLANG_OP_INC:
+			return SLANG_OP_REG_INC;
+		case SLANG_OP_DEC:
+			return SLANG_OP_REG_DEC;
+		case SLANG_OP_NEG:
+			return SLANG_OP_REG_NEG;
+		case SLANG_OP_LEFT:
+			return SLANG_OP_REG_LEFT;
+		case SLANG_OP_RIGHT:
+			return SLANG_OP_REG_RIGHT;
+		case SLANG_OP_UNBOX:
+			return SLANG_OP_REG_UNBOX;
+		case SLANG_OP_SET_LOCAL:
+		case SLANG_OP_SET_STACK:
+			return SLANG_OP_REG_STORE;
+		case SLANG_OP_CJUMP_POP:
+			return SLANG_OP_REG_CJUMP;
+		case SLANG_OP_CNJUMP_POP:
+			return SLANG_OP_REG_CNJUMP;
+		case SLANG_OP_RET:
+			return SLANG_OP_REG_RET;
+	}
+	return SLANG_OP_NOOP;
+}
+
+// slots whose copy was folded into its reader take no register,
+// so a slot's register is its height less those below it
+inline uint16_t RegisterAt(const std::vector<int32_t>& source,int32_t params,int32_t slot){
+	int32_t reg = params+slot;
+	for (int32_t i=0;i<slot;++i){
+		if (source[i]!=-1)
+			--reg;
+	}
+	return reg;
+}
+
+// rewrites a lambda body to register form: the args frame holds
+// params then let values and temporaries, each at a fixed register
+// for a given stack height. a GET_LOCAL or GET_STACK read only by a
+// register form inst is dropped and the reader names its register
+// instead. everything else stays in stack form on top of the
+// registers. false, leaving insts alone, if the heights can't
+// be followed or there was nothing to rewrite
+static bool AllocateRegisters(
+		CodeBlock& block,
+		const std::vector<CodeBlock>& lambdaCodes,
+		Vector<PeepholeInst>& insts,
+		const Vector<PeepholeCaseTarget>& caseTargets){
+	uint8_t* code = block.start;
+	size_t instCount = insts.size-1;
+	int32_t params = block.params.size;
+	
+	std::vector<uint8_t> isStart(insts.size,false);
+	for (size_t i=0;i<instCount;++i){
+		if (!insts.data[i].dead&&IsJumpOp(insts.data[i].op))
+			isStart[NextLiveInst(insts,insts.data[i].target)] = true;
+	}
+	for (size_t i=0;i<caseTargets.size;++i){
+		if (!insts.data[caseTargets.data[i].caseInst].dead)
+			isStart[NextLiveInst(insts,caseTargets.data[i].target)] = true;
+	}
+	
+	// heights before each inst and the lowest slot it consumes
+	std::vector<int32_t> before(instCount,-1);
+	std::vector<int32_t> low(instCount,-1);
+	std::vector<RegisterState> entry(insts.size);
+	std::vector<uint8_t> entered(insts.size,false);
+	RegisterState state = {0,{}};
+	bool falls = true;
+	for (size_t i=0;i<instCount;++i){
+		const PeepholeInst& inst = insts.data[i];
+		if (inst.dead)
+			continue;
+		if (isStart[i]){
+			if (falls){
+				if (!MergeRegisterState(entry,entered,i,state))
+					return false;
+			} else if (entered[i]){
+				state = entry[i];
+			} else {
+				return false;
+			}
+		} else if (!falls){
+			return false;
+		}
+		falls = !IsTerminalOp(inst.op);
+		
+		int32_t h = state.height;
+		before[i] = h;
+		low[i] = h;
+		if (h>=0&&params+h+1>=0xFFFF)
+			return false;
+		switch (inst.op){
+			case SLANG_OP_PUSH_FRAME:
+				state.frames.push_back(h);
+				break;
+			case SLANG_OP_UNPACK:
+				state.height = -1;
+				break;
+			case SLANG_OP_CALL:
+			case SLANG_OP_CALLSYM:
+			case SLANG_OP_MAP_STEP:
+			case SLANG_OP_FOREACH_STEP:
+			case SLANG_OP_FILTER_STEP:
+			case SLANG_OP_FOLD_STEP:
+			case SLANG_OP_MAKE_VEC:
+				if (state.frames.empty())
+					return false;
+				low[i] = state.frames.back();
+				state.height = (low[i]<0) ? -1 : low[i]+1;
+				state.frames.pop_back();
+				break;
+			case SLANG_OP_RET:
+			case SLANG_OP_RETCALL:
+			case SLANG_OP_RETCALLSYM:
+			case SLANG_OP_RECURSE:
+				break;
+			case SLANG_OP_JUMP:
+			case SLANG_OP_CJUMP:
+			case SLANG_OP_CNJUMP:
+				if (!MergeRegisterState(entry,entered,NextLiveInst(insts,inst.target),state))
+					return false;
+				break;
+			case SLANG_OP_CJUMP_POP:
+			case SLANG_OP_CNJUMP_POP:
+				if (h==0)
+					return false;
+				if (h>0)
+					state.height = low[i] = h-1;
+				if (!MergeRegisterState(entry,entered,NextLiveInst(insts,inst.target),state))
+					return false;
+				break;
+			case SLANG_OP_CASE_JUMP:
+				if (h==0)
+					return false;
+				if (h>0)
+					state.height = low[i] = h-1;
+				for (size_t j=0;j<caseTargets.size;++j){
+					if (caseTargets.data[j].caseInst!=i)
+						continue;
+					if (!MergeRegisterState(entry,entered,NextLiveInst(insts,caseTargets.data[j].target),state))
+						return false;
+				}
+				break;
+			case SLANG_OP_TRY:
+				// the handler starts with the empty maybe pushed
+				if (h>=0)
+					++state.height;
+				if (!MergeRegisterState(entry,entered,NextLiveInst(insts,inst.target),state))
+					return false;
+				state.height = h;
+				break;
+			default: {
+				int32_t pops,pushes;
+				if (!RegisterStackEffect(code,inst,lambdaCodes,pops,pushes))
+					return false;
+				if (h<0)
+					break;
+				if (pops>h)
+					return false;
+				if (inst.op==SLANG_OP_GET_LOCAL||inst.op==SLANG_OP_SET_LOCAL){
+					if (InstLocal(code,inst)>=params)
+						return false;
+				} else if (inst.op==SLANG_OP_GET_STACK){
+					int32_t slot = h-(int32_t)*(uint32_t*)(code+inst.offset+OPCODE_SIZE);
+					if (slot<0||slot>=h)
+						return false;
+				} else if (inst.op==SLANG_OP_SET_STACK){
+					int32_t slot = h-(int32_t)*(uint32_t*)(code+inst.offset+OPCODE_SIZE);
+					if (slot<0||slot>=h-1)
+						return false;
+				}
+				low[i] = h-pops;
+				state.height = h-pops+pushes;
+				break;
+			}
+		}
+	}
+	
+	// pick the copies that can be folded into their reader, a
+	// copy is only folded within its block and while nothing
+	// can write the register it was taken from
+	std::vector<uint8_t> folded(instCount,false);
+	std::vector<uint8_t> regForm(instCount,false);
+	std::vector<int32_t> pending;
+	bool any = false;
+	for (size_t i=0;i<instCount;++i){
+		const PeepholeInst& inst = insts.data[i];
+		if (inst.dead)
+			continue;
+		int32_t h = before[i];
+		if (isStart[i]||h<0){
+			pending.clear();
+			if (h<0)
+				continue;
+		}
+		pending.resize(h,-1);
+		
+		if (inst.op==SLANG_OP_GET_LOCAL){
+			pending.push_back(i);
+			continue;
+		}
+		if (inst.op==SLANG_OP_GET_STACK){
+			pending[h-*(uint32_t*)(code+inst.offset+OPCODE_SIZE)] = -1;
+			pending.push_back(i);
+			continue;
+		}
+		
+		int32_t count;
+		if (RegisterFormOp(code,inst,count)!=SLANG_OP_NOOP){
+			if (inst.op==SLANG_OP_SET_LOCAL||inst.op==SLANG_OP_SET_STACK){
+				for (int32_t s=0;s<h-1;++s)
+					pending[s] = -1;
+			}
+			for (int32_t s=h-count;s<h;++s){
+				if (pending[s]==-1)
+					continue;
+				folded[pending[s]] = true;
+				regForm[i] = true;
+				any = true;
+			}
+		}
+		pending.resize(low[i]);
+		if (IsJumpOp(inst.op)||IsTerminalOp(inst.op)||inst.op==SLANG_OP_UNPACK)
+			pending.clear();
+	}
+	if (!any)
+		return false;
+	
+	// source register of each folded copy still on the stack
+	std::vector<int32_t> source;
+	for (size_t i=0;i<instCount;++i){
+		PeepholeInst& inst = insts.data[i];
+		if (inst.dead)
+			continue;
+		int32_t h = before[i];
+		if (h<0)
+			continue;
+		source.resize(h,-1);
+		
+		if (inst.op==SLANG_OP_GET_LOCAL){
+			source.push_back(folded[i] ? InstLocal(code,inst) : -1);
+			inst.dead = folded[i];
+			continue;
+		}
+		if (inst.op==SLANG_OP_GET_STACK){
+			uint32_t* idx = (uint32_t*)(code+inst.offset+OPCODE_SIZE);
+			int32_t reg = RegisterAt(source,params,h-*idx);
+			if (folded[i]){
+				source.push_back(reg);
+				inst.dead = true;
+			} else {
+				// still relative to the real top
+				*idx = RegisterAt(source,params,h)-reg;
+				source.push_back(-1);
+			}
+			continue;
+		}
+		
+		if (regForm[i]){
+			int32_t count;
+			uint8_t op = RegisterFormOp(code,inst,count);
+			uint16_t regs[2] = {0,0};
+			for (int32_t k=0;k<count;++k){
+				int32_t s = h-count+k;
+				regs[k] = (source[s]!=-1) ? source[s] : RegisterAt(source,params,s);
+			}
+			uint16_t top = RegisterAt(source,params,h-count);
+			switch (op){
+				case SLANG_OP_REG_STORE:
+					if (inst.op==SLANG_OP_SET_LOCAL)
+						inst.operands[0] = InstLocal(code,inst);
+					else
+						inst.operands[0] = RegisterAt(source,params,h-*(uint32_t*)(code+inst.offset+OPCODE_SIZE));
+					inst.operands[1] = regs[0];
+					inst.operands[2] = top;
+					break;
+				case SLANG_OP_REG_CJUMP:
+				case SLANG_OP_REG_CNJUMP:
+					inst.operands[0] = regs[0];
+					inst.operands[1] = top;
+					break;
+				case SLANG_OP_REG_RET:
+					inst.operands[0] = regs[0];
+					break;
+				default:
+					// result goes where the first arg was
+					inst.operands[0] = top;
+					inst.operands[1] = regs[0];
+					inst.operands[2] = regs[1];
+					break;
+			}
+			inst.op = op;
+		}
+		source.resize(low[i]);
+	}
+	return true;
+}
+#endif
+
+void CodeWriter::Optimize(CodeBlock& block,bool lambdaBody){
+	size_t codeSize = block.write-block.start;
+	Vector<PeepholeInst> insts;
+	Vector<uint32_t> instAt;
+	Vector<uint8_t> isTarget;
+	Vector<PeepholeCaseTarget> caseTargets;
+	instAt.AddSize(codeSize+1);
+	memset(instAt.data,0xFF,sizeof(uint32_t)*instAt.size);
+	insts.Reserve(codeSize/2+1);
+	
+	for (size_t pos=0;pos<codeSize;pos+=SlangOpSizes[block.start[pos]]){
+		instAt.data[pos] = insts.size;
+		PeepholeInst& inst = insts.PlaceBack();
+		inst.offset = pos;
+		inst.op = block.start[pos];
+		inst.dead = false;
+		inst.target = -1U;
+	}
+	// end sentinel, never dead
+	instAt.data[codeSize] = insts.size;
+	PeepholeInst& end = insts.PlaceBack();
+	end.offset = codeSize;
+	end.op = SLANG_OP_NOOP;
+	end.dead = false;
+	end.target = -1U;
+	size_t instCount = insts.size-1;
+	
+	for (size_t i=0;i<instCount;++i){
+		PeepholeInst& inst = insts.data[i];
+		if (IsJumpOp(inst.op)){
+			int32_t dist = *(int32_t*)(block.start+inst.offset+OPCODE_SIZE);
+			inst.target = instAt.data[inst.offset+dist];
+			assert(inst.target!=-1U);
+		} else if (inst.op==SLANG_OP_CASE_JUMP){
+			uint32_t dictIndex = *(uint32_t*)(block.start+inst.offset+OPCODE_SIZE);
+			const CaseDict& dict = caseDicts.data[dictIndex];
+			caseTargets.PushBack({(uint32_t)i,instAt.data[inst.offset+dict.elseOffset]});
+			for (size_t j=0;j<dict.capacity;++j){
+				const CaseDictElement& elem = caseDictElements.data[dict.elemsStart+j];
+				if ((uint64_t)elem.key==DICT_UNOCCUPIED_VAL)
+					continue;
+				caseTargets.PushBack({(uint32_t)i,instAt.data[inst.offset+elem.offset]});
+			}
+		}
+	}
+	
+	isTarget.AddSize(insts.size);
+	bool changed = true;
+	while (changed){
+		changed = false;
+		MarkJumpTargets(insts,caseTargets,isTarget);
+		
+		// drop unreachable code
+		bool reachable = true;
+		for (size_t i=0;i<instCount;++i){
+			PeepholeInst& inst = insts.data[i];
+			if (inst.dead)
+				continue;
+			if (isTarget.data[i])
+				reachable = true;
+			if (!reachable){
+				inst.dead = true;
+				changed = true;
+				continue;
+			}
+			if (IsTerminalOp(inst.op))
+				reachable = false;
+		}
+		
+		// thread jumps to jumps
+		for (size_t i=0;i<instCount;++i){
+			PeepholeInst& inst = insts.data[i];
+			if (inst.dead||!IsJumpOp(inst.op)||inst.op==SLANG_OP_TRY)
+				continue;
+			
+			uint32_t target = NextLiveInst(insts,inst.target);
+			for (size_t hops=0;hops<16;++hops){
+				const PeepholeInst& t = insts.data[target];
+				if (t.op==SLANG_OP_JUMP&&target!=i){
+					target = NextLiveInst(insts,t.target);
+				} else if ((inst.op==SLANG_OP_CJUMP||inst.op==SLANG_OP_CNJUMP)&&t.op==inst.op){
+					// same test on the same value
+					target = NextLiveInst(insts,t.target);
+				} else if ((inst.op==SLANG_OP_CJUMP&&t.op==SLANG_OP_CNJUMP)||
+						(inst.op==SLANG_OP_CNJUMP&&t.op==SLANG_OP_CJUMP)){
+					// opposite test can never be taken
+					target = NextLiveInst(insts,target+1);
+				} else {
+					break;
+				}
+			}
+			if (target!=inst.target){
+				inst.target = target;
+				changed = true;
+			}
+		}
+		
+		MarkJumpTargets(insts,caseTargets,isTarget);
+		for (size_t i=0;i<instCount;++i){
+			PeepholeInst& inst = insts.data[i];
+			if (inst.dead)
+				continue;
+			size_t next = NextLiveInst(insts,i+1);
+			PeepholeInst& nextInst = insts.data[next];
+			
+			if (inst.op==SLANG_OP_JUMP){
+				if (inst.target==next){
+					inst.dead = true;
+					changed = true;
+				} else if (insts.data[inst.target].op==SLANG_OP_RET){
+					inst.op = SLANG_OP_RET;
+					changed = true;
+				}
+			} else if (inst.op==SLANG_OP_NOT&&!isTarget.data[next]){
+				if (nextInst.op==SLANG_OP_CJUMP_POP){
+					inst.dead = true;
+					nextInst.op = SLANG_OP_CNJUMP_POP;
+					changed = true;
+				} else if (nextInst.op==SLANG_OP_CNJUMP_POP){
+					inst.dead = true;
+					nextInst.op = SLANG_OP_CJUMP_POP;
+					changed = true;
+				}
+			} else if (IsPlainPushOp(inst.op)&&nextInst.op==SLANG_OP_POP_ARG&&!isTarget.data[next]){
+				inst.dead = true;
+				nextInst.dead = true;
+				changed = true;
+			}
+		}
+	}
+	
+	MarkJumpTargets(insts,caseTargets,isTarget);
+	bool registers = false;
+#ifdef SLANG_REGISTER_VM
+	// registers are numbered from the args frame, only lambda bodies
+	// have one. what's left in stack form can still be fused
+	if (lambdaBody&&AllocateRegisters(block,lambdaCodes,insts,caseTargets)){
+		registers = true;
+		MarkJumpTargets(insts,caseTargets,isTarget);
+	}
+#else
+	(void)lambdaBody;
+#endif
+	for (size_t i=0;i<instCount;++i){
+		PeepholeInst& inst = insts.data[i];
+		if (inst.dead)
+			continue;
+		uint8_t fused = FusedOpAt(block.start,insts,isTarget,i,true);
+		if (fused==SLANG_OP_NOOP)
+			continue;
+		
+		size_t j = NextLiveInst(insts,i+1);
+		PeepholeInst& next = insts.data[j];
+		switch (fused){
+			case SLANG_OP_PUSH_FRAME_LOCAL:
+				inst.operands[0] = InstLocal(block.start,next);
+				break;
+			case SLANG_OP_DEC_LOCAL:
+				inst.operands[0] = InstLocal(block.start,inst);
+				break;
+			case SLANG_OP_CJUMP_LOCAL:
+				inst.operands[0] = InstLocal(block.start,inst);
+				inst.target = next.target;
+				break;
+			case SLANG_OP_ADD_LOCALS:
+				insts.data[NextLiveInst(insts,j+1)].dead = true;
+				inst.operands[0] = InstLocal(block.start,inst);
+				inst.operands[1] = InstLocal(block.start,next);
+				break;
+			case SLANG_OP_GET_LOCAL2:
+				inst.operands[0] = InstLocal(block.start,inst);
+				inst.operands[1] = InstLocal(block.start,next);
+				break;
+		}
+		inst.op = fused;
+		next.dead = true;
+	}
+	
+	// dead insts take the offset of the next live one
+	Vector<uint32_t> newOffsets;
+	newOffsets.AddSize(insts.size);
+	uint32_t pos = 0;
+	for (size_t i=0;i<insts.size;++i){
+		newOffsets.data[i] = pos;
+		if (!insts.data[i].dead&&i!=instCount)
+			pos += SlangOpSizes[insts.data[i].op];
+	}
+	
+	if (pos==codeSize&&!registers)
+		return;
+	
+	// register form insts can be longer than the stack insts they
+	// replace, so it's written out from a copy, otherwise code only moves down
+	const uint8_t* code = block.start;
+	Vector<uint8_t> oldCode;
+	if (registers){
+		oldCode.AddSize(codeSize);
+		memcpy(oldCode.data,block.start,codeSize);
+		code = oldCode.data;
+		if (pos>block.size){
+			totalAlloc += pos-block.size;
+			block.start = (uint8_t*)realloc(block.start,pos);
+			block.size = pos;
+		}
+	}
+	
+	for (size_t i=0;i<instCount;++i){
+		const PeepholeInst& inst = insts.data[i];
+		if (inst.dead)
+			continue;
+		uint8_t* write = block.start+newOffsets.data[i];
+		switch (inst.op){
+			case SLANG_OP_GET_LOCAL2:
+			case SLANG_OP_ADD_LOCALS:
+			case SLANG_OP_REG_NOT:
+			case SLANG_OP_REG_INC:
+			case SLANG_OP_REG_DEC:
+			case SLANG_OP_REG_NEG:
+			case SLANG_OP_REG_LEFT:
+			case SLANG_OP_REG_RIGHT:
+			case SLANG_OP_REG_UNBOX:
+				*(uint16_t*)(write+OPCODE_SIZE) = inst.operands[0];
+				*(uint16_t*)(write+OPCODE_SIZE+2) = inst.operands[1];
+				break;
+			case SLANG_OP_REG_STORE:
+			case SLANG_OP_REG_ADD:
+			case SLANG_OP_REG_SUB:
+			case SLANG_OP_REG_MUL:
+			case SLANG_OP_REG_DIV:
+			case SLANG_OP_REG_EQ:
+			case SLANG_OP_REG_PAIR:
+				*(uint16_t*)(write+OPCODE_SIZE) = inst.operands[0];
+				*(uint16_t*)(write+OPCODE_SIZE+2) = inst.operands[1];
+				*(uint16_t*)(write+OPCODE_SIZE+4) = inst.operands[2];
+				break;
+			case SLANG_OP_PUSH_FRAME_LOCAL:
+			case SLANG_OP_DEC_LOCAL:
+			case SLANG_OP_REG_RET:
+				*(uint16_t*)(write+OPCODE_SIZE) = inst.operands[0];
+				break;
+			case SLANG_OP_CJUMP_LOCAL:
+				*(uint16_t*)(write+OPCODE_SIZE+4) = inst.operands[0];
+				break;
+			case SLANG_OP_REG_CJUMP:
+			case SLANG_OP_REG_CNJUMP:
+				*(uint16_t*)(write+OPCODE_SIZE+4) = inst.operands[0];
+				*(uint16_t*)(write+OPCODE_SIZE+6) = inst.operands[1];
+				break;
+			default:
+				memmove(write,code+inst.offset,SlangOpSizes[inst.op]);
+				break;
+		}
+		*write = inst.op;
+		
+		if (IsJumpOp(inst.op)){
+			*(int32_t*)(write+OPCODE_SIZE) = newOffsets.data[inst.target]-newOffsets.data[i];
+		} else if (inst.op==SLANG_OP_CASE_JUMP){
+			uint32_t dictIndex = *(uint32_t*)(write+OPCODE_SIZE);
+			CaseDict& dict = caseDicts.data[dictIndex];
+			dict.elseOffset = newOffsets.data[instAt.data[inst.offset+dict.elseOffset]]-newOffsets.data[i];
+			for (size_t j=0;j<dict.capacity;++j){
+				CaseDictElement& elem = caseDictElements.data[dict.elemsStart+j];
+				if ((uint64_t)elem.key==DICT_UNOCCUPIED_VAL)
+					continue;
+				elem.offset = newOffsets.data[instAt.data[inst.offset+elem.offset]]-newOffsets.data[i];
+			}
+		}
+	}
+	
+	for (size_t i=0;i<block.locData.size;++i){
+		CodeLocationPair& loc = block.locData.data[i];
+		assert(instAt.data[loc.codeIndex]!=-1U);
+		loc.codeIndex = newOffsets.data[instAt.data[loc.codeIndex]];
+	}
+	
+	block.write = block.start+pos;
+}
+
+bool CodeWriter::KnownLambdaArityCheck(const SlangHeader* expr,SymbolName sym,size_t argCount){
+	for (size_t i=knownLambdaStack.size()-1;i!=-1ULL;--i){
+		const auto& layer = knownLambdaStack[i];
+		if (layer.contains(sym)){
+			const CodeBlock& block = lambdaCodes[layer.at(sym)];
+			size_t pCount = block.params.size;
+			if (block.isVariadic){
+				if (argCount<(size_t)(pCount-1)){
+					ArityError(expr,argCount,pCount-1,VARIADIC_ARG_COUNT);
+					return false;
+				}
+			} else {
+				if (argCount!=pCount){
+					ArityError(expr,argCount,pCount,pCount);
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+	return true;
+}
+
+#define COMPILE_GLOBAL_SYM(func) \
+	if (!func(expr)) \
+		return false; \
+	if (terminating) \
+		WriteRet(); \
+	AddCodeLocation(expr); \
+	return true
+
+bool CodeWriter::CompileExpr(const SlangHeader* expr,bool terminating){
+	if (GetType(expr)!=SlangType::List){
+		if (!CompileConst(expr))
+			return false;
+		if (terminating){
+			WriteRet();
+		}
+		return true;
+	}
+	bool recurse = false;
+	
+	SlangList* list = (SlangList*)expr;
+	
+	SlangHeader* head = list->left;
+	SlangType t = GetType(head);
+	if (t!=SlangType::Symbol&&t!=SlangType::List){
+		TypeError(expr,t,SlangType::Lambda);
+		return false;
+	}
+	
+	if (IsDotted(list)){
+		DotError((SlangHeader*)list);
+		return false;
+	}
+	
+	size_t argCount = GetArgCount(list)-1;
+	bool inlineSymHead = false;
+	size_t boxedCallee = -1ULL;
+	
+	if (t==SlangType::Symbol){
+		SymbolName sym = ((SlangObj*)head)->symbol;
+		if (sym<GLOBAL_SYMBOL_COUNT){
+			if (!GoodArity(sym,argCount)){
+				ArityError(head,argCount,gGlobalArityArray[sym].min,gGlobalArityArray[sym].max);
+				return false;
+			}
+			inlineSymHead = true;
+			// special cases (def, &, ...)
+			switch (sym){
+				case SLANG_DEFINE:
+				case SLANG_SET:
+					COMPILE_GLOBAL_SYM(CompileDefine);
+				case SLANG_DO:
+					return CompileDo(expr,terminating);
+				case SLANG_IF:
+					return CompileIf(expr,terminating);
+				case SLANG_COND:
+					return CompileCond(expr,terminating);
 				case SLANG_CASE:
 					return CompileCase(expr,terminating);
 				case SLANG_LET:
@@ -5209,6 +7021,11 @@ bool CodeWriter::CompileExpr(const SlangHeader* expr,bool terminating){
 			if (!lambdaStack.empty()&&sym==lambdaStack.back().funcName){
 				recurse = true;
 			}
+			// a named let whose params were boxed by its inits
+			// expects them boxed from every call
+			boxedCallee = SelfLevelOf(sym);
+			if (boxedCallee!=-1ULL&&lambdaStack[boxedCallee].initBoxed.empty())
+				boxedCallee = -1ULL;
 		}
 	}
 	
@@ -5218,6 +7035,11 @@ bool CodeWriter::CompileExpr(const SlangHeader* expr,bool terminating){
 	for (size_t i=0;i<argCount;++i){
 		if (!CompileExpr(argIt->left))
 			return false;
+		if (boxedCallee!=-1ULL){
+			const LambdaData& callee = lambdaStack[boxedCallee];
+			if (i<callee.params.size&&callee.initBoxed.contains(callee.params.data[i]))
+				WriteOpCode(SLANG_OP_MAKE_BOX);
+		}
 		
 		argIt = (SlangList*)argIt->right;
 	}
@@ -5225,7 +7047,11 @@ bool CodeWriter::CompileExpr(const SlangHeader* expr,bool terminating){
 	if (!IsList((SlangHeader*)argIt)) return false;
 	
 	if (!(terminating&&recurse)){
-		if (!inlineSymHead){
+		if (boxedCallee!=-1ULL){
+			VarRef ref;
+			ResolveVar(((SlangObj*)head)->symbol,ref);
+			WriteVarRef(ref);
+		} else if (!inlineSymHead){
 			if (!CompileExpr(head))
 				return false;
 		}
@@ -5252,8 +7078,8 @@ bool CodeWriter::CompileExpr(const SlangHeader* expr,bool terminating){
 void CodeWriter::MakeDefaultObjs(){
 	constTrueObj = alloc.MakeBool(true);
 	constFalseObj = alloc.MakeBool(false);
-	constZeroObj = (SlangHeader*)alloc.MakeInt(0);
-	constOneObj = (SlangHeader*)alloc.MakeInt(1);
+	constZeroObj = alloc.MakeInt(0);
+	constOneObj = alloc.MakeInt(1);
 	constEOFObj = alloc.MakeEOF();
 	constElseObj = (SlangHeader*)alloc.MakeSymbol(SLANG_ELSE);
 }
@@ -5271,6 +7097,9 @@ CodeWriter::CodeWriter(SlangParser& parser)
 CodeWriter::~CodeWriter(){
 	for (const auto& block : lambdaCodes){
 		free(block.start);
+#ifdef SLANG_JIT
+		FreeJitCode(block.jit);
+#endif
 	}
 	lambdaCodes.clear();
 	
@@ -5287,8 +7116,13 @@ inline size_t CodeWriter::AllocNewBlock(size_t initSize){
 	block.isVariadic = false;
 	block.isPure = true;
 	block.isClosure = false;
+	block.selfCapture = NO_CAPTURE;
 	block.moduleIndex = currModuleIndex;
 	block.name = EMPTY_NAME;
+#ifdef SLANG_JIT
+	block.jit = nullptr;
+	block.callCount = 0;
+#endif
 	totalAlloc += initSize;
 	return index;
 }
@@ -5297,6 +7131,9 @@ void CodeWriter::Reset(){
 	errors.clear();
 	for (const auto& block : lambdaCodes){
 		free(block.start);
+#ifdef SLANG_JIT
+		FreeJitCode(block.jit);
+#endif
 	}
 	lambdaCodes.clear();
 	lambdaStack.clear();
@@ -5344,61 +7181,61 @@ inline void CodeInterpreter::LoadTry(){
 	PushArg((SlangHeader*)emptyMaybe);
 }
 
-inline void CodeInterpreter::Call(size_t funcIndex,SlangEnv* env,bool isClosure){
+// where a call into the block starts, native code is entered
+// through a one op stub so the bytecode is never patched
+inline const uint8_t* CodeInterpreter::BlockEntry(CodeBlock& cb){
+#ifdef SLANG_JIT
+	if (JitReady(cb)&&JitEnters(cb,cb.start)){
+		jitResume = cb.start;
+		return &gJitEnterStub.op;
+	}
+#endif
+	return cb.start;
+}
+
+inline void CodeInterpreter::Call(size_t funcIndex,SlangEnv* env){
 	FuncData& f = funcStack.PlaceBack();
 	f.funcIndex = funcIndex;
 	f.argsFrame = stack.size-1;
 	f.env = env;
-	const CodeBlock& cb = codeWriter.lambdaCodes[funcIndex];
+	CodeBlock& cb = codeWriter.lambdaCodes[funcIndex];
 	f.globalEnv = modules.data[cb.moduleIndex].globalEnv;
 	
 	f.retAddr = pc+SlangOpSizes[*pc];
-	f.isClosure = isClosure;
-	uint8_t* code = cb.start;
-	pc = code-SlangOpSizes[*pc];
+	pc = BlockEntry(cb)-SlangOpSizes[*pc];
 }
 
-inline void CodeInterpreter::RetCall(size_t funcIndex,SlangEnv* env,bool isClosure){
-	StackData& d = stack.Back();
+// the new args replace the caller's in one move, the args frame
+// and ret addr of the replaced call are reused as is
+inline void CodeInterpreter::MoveArgsDown(){
 	FuncData& f = funcStack.Back();
-	f.funcIndex = funcIndex;
-	f.env = env;
-	const CodeBlock& cb = codeWriter.lambdaCodes[funcIndex];
-	f.globalEnv = modules.data[cb.moduleIndex].globalEnv;
-	f.isClosure = isClosure;
-	uint8_t* code = cb.start;
-	size_t argCount = GetArgCount();
 	size_t lowerBase = stack.data[f.argsFrame].base;
-	size_t upperBase = d.base;
-	// copy args down
-	for (size_t i=0;i<argCount;++i){
-		SlangHeader* arg = argStack.data[upperBase+i];
-		if (arg&&arg->type==SlangType::Lambda)
-			arg->flags |= FLAG_CLOSURE;
-		argStack.data[lowerBase+i] = arg;
-	}
-	pc = code-SlangOpSizes[*pc];
+	size_t upperBase = stack.Back().base;
+	size_t argCount = argStack.size-upperBase;
+	memmove(
+		&argStack.data[lowerBase],
+		&argStack.data[upperBase],
+		argCount*sizeof(SlangHeader*)
+	);
 	// manual pop frame
 	stack.PopBack();
 	argStack.size = lowerBase+argCount;
 }
 
-inline void CodeInterpreter::Recurse(){
-	StackData& d = stack.Back();
+inline void CodeInterpreter::RetCall(size_t funcIndex,SlangEnv* env){
 	FuncData& f = funcStack.Back();
-	size_t funcIndex = f.funcIndex;
-	uint8_t* code = codeWriter.lambdaCodes[funcIndex].start;
-	size_t argCount = GetArgCount();
-	size_t lowerBase = stack.data[f.argsFrame].base;
-	size_t upperBase = d.base;
-	// copy args down
-	for (size_t i=0;i<argCount;++i){
-		argStack.data[lowerBase+i] = argStack.data[upperBase+i];
-	}
-	pc = code-SlangOpSizes[SLANG_OP_RECURSE];
-	// manual pop frame
-	stack.PopBack();
-	argStack.size = lowerBase+argCount;
+	f.funcIndex = funcIndex;
+	f.env = env;
+	CodeBlock& cb = codeWriter.lambdaCodes[funcIndex];
+	f.globalEnv = modules.data[cb.moduleIndex].globalEnv;
+	MoveArgsDown();
+	pc = BlockEntry(cb)-SlangOpSizes[*pc];
+}
+
+inline void CodeInterpreter::Recurse(){
+	MoveArgsDown();
+	CodeBlock& cb = codeWriter.lambdaCodes[funcStack.Back().funcIndex];
+	pc = BlockEntry(cb)-SlangOpSizes[SLANG_OP_RECURSE];
 }
 
 inline void CodeInterpreter::Return(SlangHeader* val){
@@ -5424,6 +7261,7 @@ inline SlangEnv* CodeInterpreter::AllocateEnvs(size_t size){
 		} else {
 			prev = (SlangEnv*)PopArg();
 			prev->next = obj;
+			WriteBarrier(prev,(SlangHeader*)obj);
 		}
 		prev = obj;
 		PushArg((SlangHeader*)prev);
@@ -5440,9 +7278,11 @@ inline void CodeInterpreter::DefEnvSymbol(SlangEnv* e,SymbolName name,SlangHeade
 		newEnv->DefSymbol(name,PopArg());
 		e = (SlangEnv*)PopArg();
 		e->AddBlock(newEnv);
+		WriteBarrier(e,(SlangHeader*)newEnv);
 		return;
 	}
 	PopArg();
+	WriteBarrier(e,val);
 }
 
 void CodeInterpreter::DefOrSetEnvSymbol(SlangEnv* e,SymbolName name,SlangHeader* val){
@@ -5454,33 +7294,39 @@ void CodeInterpreter::DefOrSetEnvSymbol(SlangEnv* e,SymbolName name,SlangHeader*
 			newEnv->DefSymbol(name,PopArg());
 			e = (SlangEnv*)PopArg();
 			e->AddBlock(newEnv);
+			WriteBarrier(e,(SlangHeader*)newEnv);
 			return;
 		}
 		PopArg();
 	}
+	WriteBarrier(e,val);
 }
 
-inline void CodeInterpreter::DefCurrEnvSymbol(SymbolName name,SlangHeader* val){
-	SlangEnv* e = GetCurrEnv();
-	if (!e->DefSymbol(name,val)){
+// defines or sets name in a module env, appending to the
+// last block instead of walking the chain
+inline void CodeInterpreter::DefIndexedSymbol(EnvIndex& index,SymbolName name,SlangHeader* val){
+	size_t pos = index.Lookup(name);
+	if (pos!=-1ULL){
+		index.MappingAt(pos)->obj = val;
+		WriteBarrier(index.BlockAt(pos),val);
+		return;
+	}
+	
+	SlangEnv* last = index.LastBlock();
+	if (last->header.varCount==SLANG_ENV_BLOCK_SIZE){
 		PushArg(val);
 		SlangEnv* newEnv = AllocateEnvs(1);
-		newEnv->DefSymbol(name,PopArg());
-		e = GetCurrEnv();
-		e->AddBlock(newEnv);
-	}
-}
-
-inline bool CodeInterpreter::SetRecursiveSymbol(SymbolName name,SlangHeader* val){
-	SlangHeader* t;
-	SlangEnv* e = GetCurrEnv();
-	while (e){
-		if (e->GetSymbol(name,&t)){
-			return e->SetSymbol(name,val);
-		}
-		e = e->parent;
+		val = PopArg();
+		newEnv->parent = nullptr;
+		last = index.LastBlock();
+		last->next = newEnv;
+		WriteBarrier(last,(SlangHeader*)newEnv);
+		index.PushBlock(newEnv);
+		last = newEnv;
 	}
-	return false;
+	last->DefSymbol(name,val);
+	index.Insert(name,index.count++);
+	WriteBarrier(last,val);
 }
 
 size_t CodeInterpreter::GetPCOffset() const {
@@ -5490,43 +7336,49 @@ size_t CodeInterpreter::GetPCOffset() const {
 inline SlangLambda* CodeInterpreter::CreateLambda(size_t index){
 	CodeBlock& block = codeWriter.lambdaCodes[index];
 	SlangLambda* lam = alloc.AllocateLambda();
-	//lam->header.varCount = 0;//block.params.size;
 	if (block.isVariadic)
 		lam->header.flags |= FLAG_VARIADIC;
 	lam->funcIndex = index;
-	if (block.isClosure){
-		//lam->header.flags |= FLAG_CLOSURE;
-		PushArg((SlangHeader*)lam);
-		size_t pCount = block.params.size;
-		size_t dCount = block.defs.size;
-		if (block.name!=EMPTY_NAME&&block.name!=LET_SELF_SYM)
-			++pCount;
-		SlangEnv* newEnv = AllocateEnvs(pCount+dCount);
-		lam = (SlangLambda*)PopArg();
-		lam->env = newEnv;
-		lam->env->parent = GetCurrEnv();
-		ParamData& pd = block.params;
-		SlangEnv* envIt = newEnv;
-		for (uint16_t i=0;i<pd.size;++i){
-			auto& mappingData = envIt->mappings[i%SLANG_ENV_BLOCK_SIZE];
-			mappingData.sym = pd.data[i];
-			mappingData.obj = nullptr;
-			++envIt->header.varCount;
-			
-			if (i%SLANG_ENV_BLOCK_SIZE==SLANG_ENV_BLOCK_SIZE-1){
-				envIt = envIt->next;
-			}
-		}
+	lam->env = modules.data[block.moduleIndex].globalEnv;
+	return lam;
+}
+
+// the record is a flat env of only the captured vars, their values
+// are on the arg stack in capture order, parented to the module
+// env so name lookups like def? still reach the globals
+inline SlangLambda* CodeInterpreter::CreateClosure(size_t index){
+	CodeBlock& block = codeWriter.lambdaCodes[index];
+	size_t count = block.captures.size;
+	SlangLambda* lam = alloc.AllocateLambda();
+	if (block.isVariadic)
+		lam->header.flags |= FLAG_VARIADIC;
+	lam->header.flags |= FLAG_CLOSURE;
+	lam->funcIndex = index;
+	lam->env = nullptr;
+	PushArg((SlangHeader*)lam);
+	SlangEnv* env = AllocateEnvs(count);
+	lam = (SlangLambda*)PopArg();
+	lam->env = env;
+	WriteBarrier(lam,(SlangHeader*)env);
+	env->parent = modules.data[block.moduleIndex].globalEnv;
+	WriteBarrier(env,(SlangHeader*)env->parent);
+	
+	size_t base = argStack.size-count;
+	SlangEnv* envIt = env;
+	for (size_t i=0;i<count;++i){
+		SlangMapping& mapping = envIt->mappings[i%SLANG_ENV_BLOCK_SIZE];
+		mapping.sym = block.captures.data[i];
+		if (i==block.selfCapture)
+			mapping.obj = (SlangHeader*)lam;
+		else
+			mapping.obj = argStack.data[base+i];
+		++envIt->header.varCount;
+		WriteBarrier(envIt,mapping.obj);
 		
-		if (block.name!=EMPTY_NAME&&block.name!=LET_SELF_SYM){
-			PushArg((SlangHeader*)lam);
-			DefEnvSymbol(lam->env,block.name,(SlangHeader*)lam);
-			lam = (SlangLambda*)PopArg();
-		}
-	} else {
-		lam->env = GetCurrEnv();
+		if (i%SLANG_ENV_BLOCK_SIZE==SLANG_ENV_BLOCK_SIZE-1)
+			envIt = envIt->next;
 	}
-	
+	argStack.size = base;
 	return lam;
 }
 
@@ -5548,6 +7400,7 @@ inline SlangList* CodeInterpreter::MakeVariadicList(
 		} else {
 			prev = (SlangList*)PopArg();
 			prev->right = (SlangHeader*)list;
+			WriteBarrier(prev,(SlangHeader*)list);
 		}
 		
 		prev = list;
@@ -5571,8 +7424,10 @@ inline SlangVec* CodeInterpreter::MakeVecFromArgs(size_t start,size_t end){
 SlangHeader* CodeInterpreter::Copy(SlangHeader* obj){
 	if (!obj)
 		return nullptr;
+	if (IsImmediate(obj))
+		return obj;
 	
-	switch (obj->type){
+	switch (GetType(obj)){
 		case SlangType::Int:
 		case SlangType::Real:
 		case SlangType::Symbol:
@@ -5583,6 +7438,7 @@ SlangHeader* CodeInterpreter::Copy(SlangHeader* obj){
 			SlangHeader* newObj = (SlangHeader*)alloc.Allocate(oldSize);
 			obj = PopArg();
 			memcpy(newObj,obj,oldSize);
+			newObj->flags &= ~FLAG_REMEMBERED;
 			return newObj;
 		}
 		case SlangType::List: {
@@ -5591,11 +7447,16 @@ SlangHeader* CodeInterpreter::Copy(SlangHeader* obj){
 			
 			SlangList* newList = (SlangList*)alloc.Allocate(obj->GetSize());
 			newList->header = ((SlangList*)PeekArg())->header;
+			newList->header.flags &= ~FLAG_REMEMBERED;
 			newList->left = nullptr;
 			newList->right = nullptr;
 			PushArg((SlangHeader*)newList);
-			((SlangList*)PeekArg())->left = Copy(((SlangList*)argStack.data[oldIndex])->left);
-			((SlangList*)PeekArg())->right = Copy(((SlangList*)argStack.data[oldIndex])->right);
+			SlangHeader* left = Copy(((SlangList*)argStack.data[oldIndex])->left);
+			((SlangList*)PeekArg())->left = left;
+			WriteBarrier(PeekArg(),left);
+			SlangHeader* right = Copy(((SlangList*)argStack.data[oldIndex])->right);
+			((SlangList*)PeekArg())->right = right;
+			WriteBarrier(PeekArg(),right);
 			
 			newList = (SlangList*)PopArg();
 			PopArg();
@@ -5607,23 +7468,51 @@ SlangHeader* CodeInterpreter::Copy(SlangHeader* obj){
 			newMaybe->maybe = nullptr;
 			SlangObj* oldMaybe = (SlangObj*)PopArg();
 			newMaybe->header = oldMaybe->header;
+			newMaybe->header.flags &= ~FLAG_REMEMBERED;
 			PushArg((SlangHeader*)newMaybe);
-			((SlangObj*)PeekArg())->maybe = Copy(oldMaybe->maybe);
+			SlangHeader* maybe = Copy(oldMaybe->maybe);
+			((SlangObj*)PeekArg())->maybe = maybe;
+			WriteBarrier(PeekArg(),maybe);
 			return PopArg();
 		}
+		case SlangType::Iterator: {
+			// iterators are views, the copy walks the same source
+			PushArg(obj);
+			SlangIter* newIter = (SlangIter*)alloc.Allocate(obj->GetSize());
+			SlangIter* oldIter = (SlangIter*)PopArg();
+			memcpy(newIter,oldIter,oldIter->header.GetSize());
+			newIter->header.flags &= ~FLAG_REMEMBERED;
+			return (SlangHeader*)newIter;
+		}
 		case SlangType::Vector: {
 			PushArg(obj);
 			SlangVec* newVec = (SlangVec*)alloc.Allocate(obj->GetSize());
 			SlangVec* oldVec = (SlangVec*)PopArg();
 			memcpy(newVec,oldVec,oldVec->header.GetSize());
+			newVec->header.flags &= ~FLAG_REMEMBERED;
 			if (!oldVec->storage){
 				return (SlangHeader*)newVec;
 			}
 			newVec->storage = nullptr;
+			size_t oldIndex = argStack.size;
+			PushArg((SlangHeader*)oldVec);
+			size_t newIndex = argStack.size;
 			PushArg((SlangHeader*)newVec);
 			SlangStorage* newStorage = (SlangStorage*)Copy((SlangHeader*)oldVec->storage);
-			newVec = (SlangVec*)PopArg();
+			newVec = (SlangVec*)PeekArg();
 			newVec->storage = newStorage;
+			WriteBarrier(newVec,(SlangHeader*)newStorage);
+			
+			// elements go through the vec so the gc can trace them
+			size_t s = newStorage->size;
+			for (size_t i=0;i<s;++i){
+				SlangHeader* elem = Copy(((SlangVec*)argStack.data[oldIndex])->storage->objs[i]);
+				newVec = (SlangVec*)argStack.data[newIndex];
+				newVec->storage->objs[i] = elem;
+				WriteBarrier(newVec,elem);
+			}
+			newVec = (SlangVec*)PopArg();
+			PopArg();
 			return (SlangHeader*)newVec;
 		}
 		case SlangType::String: {
@@ -5631,6 +7520,7 @@ SlangHeader* CodeInterpreter::Copy(SlangHeader* obj){
 			SlangStr* newStr = (SlangStr*)alloc.Allocate(obj->GetSize());
 			SlangStr* oldStr = (SlangStr*)PopArg();
 			memcpy(newStr,oldStr,oldStr->header.GetSize());
+			newStr->header.flags &= ~FLAG_REMEMBERED;
 			if (!oldStr->storage)
 				return (SlangHeader*)newStr;
 			newStr->storage = nullptr;
@@ -5638,77 +7528,78 @@ SlangHeader* CodeInterpreter::Copy(SlangHeader* obj){
 			SlangStorage* newStorage = (SlangStorage*)Copy((SlangHeader*)oldStr->storage);
 			newStr = (SlangStr*)PopArg();
 			newStr->storage = newStorage;
+			WriteBarrier(newStr,(SlangHeader*)newStorage);
 			return (SlangHeader*)newStr;
 		}
+		case SlangType::Packed: {
+			PushArg(obj);
+			SlangPacked* newPacked = (SlangPacked*)alloc.Allocate(obj->GetSize());
+			SlangPacked* oldPacked = (SlangPacked*)PopArg();
+			memcpy(newPacked,oldPacked,oldPacked->header.GetSize());
+			newPacked->header.flags &= ~FLAG_REMEMBERED;
+			if (!oldPacked->storage)
+				return (SlangHeader*)newPacked;
+			newPacked->storage = nullptr;
+			PushArg((SlangHeader*)newPacked);
+			SlangStorage* newStorage = (SlangStorage*)Copy((SlangHeader*)oldPacked->storage);
+			newPacked = (SlangPacked*)PopArg();
+			newPacked->storage = newStorage;
+			WriteBarrier(newPacked,(SlangHeader*)newStorage);
+			return (SlangHeader*)newPacked;
+		}
 		case SlangType::Dict: {
 			PushArg(obj);
 			SlangDict* newDict = (SlangDict*)alloc.Allocate(obj->GetSize());
 			SlangDict* oldDict = (SlangDict*)PopArg();
 			memcpy(newDict,oldDict,oldDict->header.GetSize());
+			newDict->header.flags &= ~FLAG_REMEMBERED;
 			if (!oldDict->storage)
 				return (SlangHeader*)newDict;
 			
 			newDict->storage = nullptr;
 			newDict->table = nullptr;
-			PushArg((SlangHeader*)newDict);
+			size_t oldIndex = argStack.size;
 			PushArg((SlangHeader*)oldDict);
+			size_t newIndex = argStack.size;
+			PushArg((SlangHeader*)newDict);
 			SlangDictTable* newTable = (SlangDictTable*)Copy((SlangHeader*)oldDict->table);
 			
-			oldDict = (SlangDict*)PopArg();
+			oldDict = (SlangDict*)argStack.data[oldIndex];
 			newDict = (SlangDict*)PeekArg();
 			newDict->table = newTable;
+			WriteBarrier(newDict,(SlangHeader*)newTable);
 			
 			SlangStorage* newStorage = (SlangStorage*)Copy((SlangHeader*)oldDict->storage);
-			newDict = (SlangDict*)PopArg();
+			newDict = (SlangDict*)PeekArg();
 			newDict->storage = newStorage;
+			WriteBarrier(newDict,(SlangHeader*)newStorage);
+			
+			// same as vectors, copy keys and vals through the dict
+			size_t s = newStorage->size;
+			for (size_t i=0;i<s;++i){
+				SlangDictElement* elem = &((SlangDict*)argStack.data[newIndex])->storage->elements[i];
+				if ((uint64_t)elem->key==DICT_UNOCCUPIED_VAL)
+					continue;
+				
+				SlangHeader* key = Copy(((SlangDict*)argStack.data[oldIndex])->storage->elements[i].key);
+				newDict = (SlangDict*)argStack.data[newIndex];
+				newDict->storage->elements[i].key = key;
+				WriteBarrier(newDict,key);
+				SlangHeader* val = Copy(((SlangDict*)argStack.data[oldIndex])->storage->elements[i].val);
+				newDict = (SlangDict*)argStack.data[newIndex];
+				newDict->storage->elements[i].val = val;
+				WriteBarrier(newDict,val);
+			}
+			newDict = (SlangDict*)PopArg();
+			PopArg();
 			return (SlangHeader*)newDict;
 		}
 		case SlangType::Storage: {
-			size_t oldIndex = argStack.size;
+			// shallow, owners copy their elements after attaching it
 			PushArg(obj);
-			size_t elemSize = obj->elemSize;
-			SlangStorage* oldStorage = (SlangStorage*)obj;
-			SlangStorage* newStorage = alloc.AllocateStorage(oldStorage->size,obj->elemSize);
-			oldStorage = (SlangStorage*)PeekArg();
-			if (elemSize==sizeof(uint8_t)){
-				memcpy(newStorage->data,oldStorage->data,oldStorage->size);
-				PopArg();
-				return (SlangHeader*)newStorage;
-			}
-			
-			if (elemSize==sizeof(SlangHeader*)){
-				size_t s = oldStorage->size;
-				size_t newIndex = argStack.size;
-				PushArg((SlangHeader*)newStorage);
-				for (size_t i=0;i<s;++i){
-					((SlangStorage*)argStack.data[newIndex])->objs[i] = Copy(((SlangStorage*)argStack.data[oldIndex])->objs[i]);
-					
-				}
-				newStorage = (SlangStorage*)PopArg();
-				PopArg();
-				return (SlangHeader*)newStorage;
-			}
-			
-			if (elemSize==sizeof(SlangDictElement)){
-				memcpy(
-					newStorage->elements,
-					oldStorage->elements,
-					sizeof(SlangDictElement)*oldStorage->size
-				);
-				size_t s = oldStorage->size;
-				size_t newIndex = argStack.size;
-				PushArg((SlangHeader*)newStorage);
-				for (size_t i=0;i<s;++i){
-					if ((uint64_t)((SlangStorage*)argStack.data[newIndex])->elements[i].key!=DICT_UNOCCUPIED_VAL){
-						((SlangStorage*)argStack.data[newIndex])->elements[i].key = Copy(((SlangStorage*)argStack.data[oldIndex])->elements[i].key);
-						((SlangStorage*)argStack.data[newIndex])->elements[i].val = Copy(((SlangStorage*)argStack.data[oldIndex])->elements[i].val);
-					}
-				}
-				newStorage = (SlangStorage*)PopArg();
-				PopArg();
-				return (SlangHeader*)newStorage;
-			}
-			assert(false);
+			SlangStorage* newStorage = alloc.AllocateStorage(((SlangStorage*)obj)->size,obj->elemSize);
+			SlangStorage* oldStorage = (SlangStorage*)PopArg();
+			memcpy(newStorage->data,oldStorage->data,oldStorage->size*oldStorage->header.elemSize);
 			return (SlangHeader*)newStorage;
 		}
 		case SlangType::DictTable: {
@@ -5716,6 +7607,7 @@ SlangHeader* CodeInterpreter::Copy(SlangHeader* obj){
 			SlangDictTable* newTable = alloc.AllocateDictTable(((SlangDictTable*)obj)->capacity);
 			SlangDictTable* oldTable = (SlangDictTable*)PopArg();
 			memcpy(newTable,oldTable,oldTable->header.GetSize());
+			newTable->header.flags &= ~FLAG_REMEMBERED;
 			return (SlangHeader*)newTable;
 		}
 		
@@ -5735,16 +7627,18 @@ SlangList* CodeInterpreter::CopyList(SlangList* list){
 	while (true){
 		((SlangList*)argStack.data[aindex])->left = 
 			((SlangList*)argStack.data[lindex])->left;
-		
+		WriteBarrier(argStack.data[aindex],((SlangList*)argStack.data[aindex])->left);
 		
 		argStack.data[lindex] = ((SlangList*)argStack.data[lindex])->right;
 		if (GetType(argStack.data[lindex])!=SlangType::List){
 			((SlangList*)argStack.data[aindex])->right = argStack.data[lindex];
+			WriteBarrier(argStack.data[aindex],argStack.data[lindex]);
 			break;
 		}
 		
 		SlangList* newList = alloc.AllocateList();
 		((SlangList*)argStack.data[aindex])->right = (SlangHeader*)newList;
+		WriteBarrier(argStack.data[aindex],(SlangHeader*)newList);
 		argStack.data[aindex] = (SlangHeader*)newList;
 	}
 	SlangList* retlist = (SlangList*)argStack.data[aindex+1];
@@ -5824,6 +7718,7 @@ inline void CodeInterpreter::RawDictInsertStorage(
 		
 		newStorage->size = realCount;
 		dict->storage = newStorage;
+		WriteBarrier(dict,(SlangHeader*)newStorage);
 		
 		val = PopArg();
 		key = PopArg();
@@ -5834,6 +7729,8 @@ inline void CodeInterpreter::RawDictInsertStorage(
 	elem.hash = hash;
 	elem.key = key;
 	elem.val = val;
+	WriteBarrier(dict,key);
+	WriteBarrier(dict,val);
 }
 
 inline void CodeInterpreter::RawDictInsert(SlangDict* dict,SlangHeader* key,SlangHeader* val){
@@ -5862,6 +7759,7 @@ inline void CodeInterpreter::RawDictInsert(SlangDict* dict,SlangHeader* key,Slan
 		obj = &storage->elements[*offset];
 		if (hash==obj->hash && EqualObjs(key,obj->key)){
 			obj->val = val;
+			WriteBarrier(dict,val);
 			return;
 		}
 	
@@ -5878,6 +7776,7 @@ inline SlangDict* CodeInterpreter::ReallocDict(SlangDict* dict){
 	dict = (SlangDict*)PopArg();
 	newTable->size = dict->table->size;
 	dict->table = newTable;
+	WriteBarrier(dict,(SlangHeader*)newTable);
 	
 	RehashDict(dict);
 	return dict;
@@ -5903,6 +7802,8 @@ inline void CodeInterpreter::DictInsert(SlangDict* dict,SlangHeader* key,SlangHe
 		dict = (SlangDict*)PopArg();
 		dict->storage = newStorage;
 		dict->table = table;
+		WriteBarrier(dict,(SlangHeader*)newStorage);
+		WriteBarrier(dict,(SlangHeader*)table);
 	} else if (dict->ShouldGrow()){
 		PushArg(key);
 		PushArg(val);
@@ -5925,6 +7826,7 @@ inline SlangStr* CodeInterpreter::ReallocateStr(SlangStr* str,size_t newSize){
 		newStorage->size = 0;
 		str = (SlangStr*)PopArg();
 		str->storage = newStorage;
+		WriteBarrier(str,(SlangHeader*)newStorage);
 		return str;
 	}
 	
@@ -5941,6 +7843,7 @@ inline SlangStr* CodeInterpreter::ReallocateStr(SlangStr* str,size_t newSize){
 	memcpy(&newStorage->data[0],&str->storage->data[0],str->storage->size*sizeof(uint8_t));
 	newStorage->size = str->storage->size;
 	str->storage = newStorage;
+	WriteBarrier(str,(SlangHeader*)newStorage);
 	return str;
 }
 
@@ -5965,6 +7868,7 @@ inline SlangStream* CodeInterpreter::ReallocateStream(SlangStream* stream,size_t
 	stream = (SlangStream*)PopArg();
 	assert(stream->str==newStr);
 	stream->str = newStr;
+	WriteBarrier(stream,(SlangHeader*)newStr);
 	return stream;
 }
 
@@ -6021,20 +7925,20 @@ bool ExtFuncGCRecObjSize(CodeInterpreter* c){
 		return true;
 	}
 	
-	c->Return((SlangHeader*)c->alloc.MakeInt(GetRecursiveSize(val)));
+	c->Return(c->alloc.MakeInt(GetRecursiveSize(val)));
 	return true;
 }
 
 bool ExtFuncGCObjSize(CodeInterpreter* c){
 	SlangHeader* val = c->GetArg(0);
 		
-	if (val==nullptr){
+	if (val==nullptr||IsImmediate(val)){
 		c->Return(c->codeWriter.constZeroObj);
 		return true;
 	}
 	
 	size_t count = 0;
-	switch (val->type){
+	switch (GetType(val)){
 		case SlangType::Vector:
 			count = val->GetSize();
 			count += ((SlangVec*)val)->storage->header.GetSize();
@@ -6043,6 +7947,11 @@ bool ExtFuncGCObjSize(CodeInterpreter* c){
 			count = val->GetSize();
 			count += ((SlangStr*)val)->storage->header.GetSize();
 			break;
+		case SlangType::Packed:
+			count = val->GetSize();
+			if (((SlangPacked*)val)->storage)
+				count += ((SlangPacked*)val)->storage->header.GetSize();
+			break;
 		case SlangType::Dict:
 			count = val->GetSize();
 			count += ((SlangDict*)val)->table->header.GetSize();
@@ -6053,40 +7962,123 @@ bool ExtFuncGCObjSize(CodeInterpreter* c){
 			break;
 	}
 	
-	c->Return((SlangHeader*)c->alloc.MakeInt(count));
+	c->Return(c->alloc.MakeInt(count));
 	return true;
 }
 
 bool ExtFuncGCMemSize(CodeInterpreter* c){
-	size_t size = c->arena->currPointer - c->arena->currSet;
-	c->Return((SlangHeader*)c->alloc.MakeInt(size));
+	size_t size = c->arena->currPointer - c->arena->currSet + c->arena->NurseryUsed();
+	size += c->arena->largeSize;
+	c->Return(c->alloc.MakeInt(size));
+	return true;
+}
+
+bool ExtFuncGCMemCapacity(CodeInterpreter* c){
+	size_t size = c->arena->memSize/2+c->arena->largeSize;
+	c->Return(c->alloc.MakeInt(size));
+	return true;
+}
+
+bool ExtFuncGCCodeMemSize(CodeInterpreter* c){
+	size_t size = c->codeWriter.totalAlloc;
+	c->Return(c->alloc.MakeInt(size));
+	return true;
+}
+
+inline bool SetGCConfig(CodeInterpreter* c,const GCConfig& config){
+	const char* err = CheckGCConfig(config);
+	if (err){
+		c->PushError("ValueError",err);
+		return false;
+	}
+	gGCConfig = config;
+	return true;
+}
+
+inline bool GetGCSizeArg(CodeInterpreter* c,size_t* size){
+	SlangHeader* sizeObj = c->GetArg(0);
+	TYPE_CHECK_EXACT(sizeObj,SlangType::Int);
+	if (GetInt(sizeObj)<0){
+		c->PushError("ValueError","Heap size cannot be negative!");
+		return false;
+	}
+	*size = GetInt(sizeObj);
+	return true;
+}
+
+inline bool GetGCFactorArg(CodeInterpreter* c,double* factor){
+	SlangHeader* factorObj = c->GetArg(0);
+	TYPE_CHECK_NUMERIC(factorObj);
+	if (GetType(factorObj)==SlangType::Int)
+		*factor = GetInt(factorObj);
+	else
+		*factor = GetReal(factorObj);
+	return true;
+}
+
+// the tuning funcs return their setting, given an arg they set it first
+bool ExtFuncGCMinHeap(CodeInterpreter* c){
+	if (c->GetArgCount()){
+		GCConfig config = gGCConfig;
+		if (!GetGCSizeArg(c,&config.minHeap)||!SetGCConfig(c,config))
+			return false;
+	}
+	c->Return(c->alloc.MakeInt(gGCConfig.minHeap));
+	return true;
+}
+
+bool ExtFuncGCMaxHeap(CodeInterpreter* c){
+	if (c->GetArgCount()){
+		GCConfig config = gGCConfig;
+		if (!GetGCSizeArg(c,&config.maxHeap)||!SetGCConfig(c,config))
+			return false;
+	}
+	c->Return(c->alloc.MakeInt(gGCConfig.maxHeap));
+	return true;
+}
+
+bool ExtFuncGCGrowFactor(CodeInterpreter* c){
+	if (c->GetArgCount()){
+		GCConfig config = gGCConfig;
+		if (!GetGCFactorArg(c,&config.growFactor)||!SetGCConfig(c,config))
+			return false;
+	}
+	c->Return(c->alloc.MakeReal(gGCConfig.growFactor));
 	return true;
 }
 
-bool ExtFuncGCMemCapacity(CodeInterpreter* c){
-	size_t size = c->arena->memSize/2;
-	c->Return((SlangHeader*)c->alloc.MakeInt(size));
+bool ExtFuncGCShrinkFree(CodeInterpreter* c){
+	if (c->GetArgCount()){
+		GCConfig config = gGCConfig;
+		if (!GetGCFactorArg(c,&config.shrinkFree)||!SetGCConfig(c,config))
+			return false;
+	}
+	c->Return(c->alloc.MakeReal(gGCConfig.shrinkFree));
 	return true;
 }
 
-bool ExtFuncGCCodeMemSize(CodeInterpreter* c){
-	size_t size = c->codeWriter.totalAlloc;
-	c->Return((SlangHeader*)c->alloc.MakeInt(size));
+bool ExtFuncGCTrace(CodeInterpreter* c){
+	if (c->GetArgCount()){
+		SlangHeader* traceObj = c->GetArg(0);
+		TYPE_CHECK_EXACT(traceObj,SlangType::Bool);
+		gGCConfig.trace = GetBool(traceObj);
+	}
+	c->Return(c->alloc.MakeBool(gGCConfig.trace));
 	return true;
 }
 
 bool ExtFuncGetTime(CodeInterpreter* c){
-	c->Return((SlangHeader*)c->alloc.MakeReal(GetDoubleTime()));
+	c->Return(c->alloc.MakeReal(GetDoubleTime()));
 	return true;
 }
 
 bool ExtFuncGetPerfTime(CodeInterpreter* c){
-	c->Return((SlangHeader*)c->alloc.MakeReal(GetDoublePerfTime()));
+	c->Return(c->alloc.MakeReal(GetDoublePerfTime()));
 	return true;
 }
 
 bool ExtFuncRand(CodeInterpreter* c){
-	c->Return((SlangHeader*)c->alloc.MakeInt(gRandState.Get64()));
+	c->Return(c->alloc.MakeInt(gRandState.Get64()));
 	return true;
 }
 
@@ -6094,13 +8086,13 @@ bool ExtFuncRandSeed(CodeInterpreter* c){
 	SlangHeader* seedObj = c->GetArg(0);
 	
 	TYPE_CHECK_EXACT(seedObj,SlangType::Int);
-	gRandState.Seed(((SlangObj*)seedObj)->integer);
+	gRandState.Seed(GetInt(seedObj));
 	c->Return(nullptr);
 	return true;
 }
 
 void ExtFileFinalizer(CodeInterpreter*,SlangHeader* obj){
-	assert(obj->type==SlangType::InputStream||obj->type==SlangType::OutputStream);
+	assert(GetType(obj)==SlangType::InputStream||GetType(obj)==SlangType::OutputStream);
 	SlangStream* stream = (SlangStream*)obj;
 	assert(stream->header.isFile);
 	if (stream->file){
@@ -6319,6 +8311,8 @@ bool ExtFuncPathRemove(CodeInterpreter* c){
 	return true;
 }
 
+#include "packed.cpp.inc"
+
 typedef bool(*CodeFunc)(CodeInterpreter* c);
 typedef SlangHeader*(*ExtVarCreateFunc)(CodeInterpreter* c);
 
@@ -6502,6 +8496,247 @@ const ExternalFuncData moduleGCFuncs[] = {
 		0,
 		SLANG_HEAD_PURE
 	},
+	{
+		"gc-min-heap",
+		&ExtFuncGCMinHeap,
+		0,
+		1,
+		SLANG_IMPURE
+	},
+	{
+		"gc-max-heap",
+		&ExtFuncGCMaxHeap,
+		0,
+		1,
+		SLANG_IMPURE
+	},
+	{
+		"gc-grow-factor",
+		&ExtFuncGCGrowFactor,
+		0,
+		1,
+		SLANG_IMPURE
+	},
+	{
+		"gc-shrink-free",
+		&ExtFuncGCShrinkFree,
+		0,
+		1,
+		SLANG_IMPURE
+	},
+	{
+		"gc-trace",
+		&ExtFuncGCTrace,
+		0,
+		1,
+		SLANG_IMPURE
+	},
+};
+
+const ExternalFuncData modulePackedFuncs[] = {
+	{
+		"i64vec",
+		&ExtFuncI64Vec,
+		0,
+		VARIADIC_ARG_COUNT,
+		SLANG_HEAD_PURE
+	},
+	{
+		"f64vec",
+		&ExtFuncF64Vec,
+		0,
+		VARIADIC_ARG_COUNT,
+		SLANG_HEAD_PURE
+	},
+	{
+		"u8vec",
+		&ExtFuncU8Vec,
+		0,
+		VARIADIC_ARG_COUNT,
+		SLANG_HEAD_PURE
+	},
+	{
+		"i64vec-alloc",
+		&ExtFuncI64VecAlloc,
+		1,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"f64vec-alloc",
+		&ExtFuncF64VecAlloc,
+		1,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"u8vec-alloc",
+		&ExtFuncU8VecAlloc,
+		1,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"vec->i64vec",
+		&ExtFuncVecToI64Vec,
+		1,
+		1,
+		SLANG_HEAD_PURE
+	},
+	{
+		"vec->f64vec",
+		&ExtFuncVecToF64Vec,
+		1,
+		1,
+		SLANG_HEAD_PURE
+	},
+	{
+		"vec->u8vec",
+		&ExtFuncVecToU8Vec,
+		1,
+		1,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec->vec",
+		&ExtFuncPackedToVec,
+		1,
+		1,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec-get",
+		&ExtFuncPackedGet,
+		2,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec-set!",
+		&ExtFuncPackedSet,
+		3,
+		3,
+		SLANG_IMPURE
+	},
+	{
+		"pvec-app!",
+		&ExtFuncPackedApp,
+		2,
+		2,
+		SLANG_IMPURE
+	},
+	{
+		"pvec-pop!",
+		&ExtFuncPackedPop,
+		1,
+		1,
+		SLANG_IMPURE
+	},
+	{
+		"pvec?",
+		&ExtFuncIsPacked,
+		1,
+		1,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec-add",
+		&ExtFuncPackedAdd,
+		2,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec-sub",
+		&ExtFuncPackedSub,
+		2,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec-mul",
+		&ExtFuncPackedMul,
+		2,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec-div",
+		&ExtFuncPackedDiv,
+		2,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec-dot",
+		&ExtFuncPackedDot,
+		2,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec-sum",
+		&ExtFuncPackedSum,
+		1,
+		1,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec-min",
+		&ExtFuncPackedMin,
+		1,
+		1,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec-max",
+		&ExtFuncPackedMax,
+		1,
+		1,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec-scale",
+		&ExtFuncPackedScale,
+		2,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec<",
+		&ExtFuncPackedLt,
+		2,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec>",
+		&ExtFuncPackedGt,
+		2,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec<=",
+		&ExtFuncPackedLte,
+		2,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec>=",
+		&ExtFuncPackedGte,
+		2,
+		2,
+		SLANG_HEAD_PURE
+	},
+	{
+		"pvec=",
+		&ExtFuncPackedEq,
+		2,
+		2,
+		SLANG_HEAD_PURE
+	},
 };
 
 const BuiltinModuleData SlangBuiltinModules[] = {
@@ -6533,6 +8768,13 @@ const BuiltinModuleData SlangBuiltinModules[] = {
 		NULL,
 		0
 	},
+	{
+		"packed",
+		modulePackedFuncs,
+		SL_ARR_LEN(modulePackedFuncs),
+		NULL,
+		0
+	},
 };
 #define BUILTIN_MODULE_COUNT SL_ARR_LEN(SlangBuiltinModules)
 
@@ -6611,7 +8853,9 @@ inline SlangStream* CodeInterpreter::MakeStringOutputStream(SlangStr* str){
 	if (!str){
 		str = alloc.AllocateStr(8);
 		str->storage->size = 0;
+		PushArg((SlangHeader*)str);
 		stream = alloc.AllocateStream(SlangType::OutputStream);
+		str = (SlangStr*)PopArg();
 		stream->str = str;
 		stream->pos = 0;
 	} else {
@@ -6631,6 +8875,24 @@ inline void CodeInterpreter::ImportEnv(const SlangEnv* env){
 		return;
 	SlangEnv* currEnv = GetCurrEnv();
 	PushArg((SlangHeader*)env);
+	if (currEnv==funcStack.Back().globalEnv){
+		EnvIndex& index = GetGlobalIndex();
+		while (true){
+			for (size_t i=0;i<env->header.varCount;++i){
+				SymbolName sym = env->mappings[i].sym;
+				if (index.Lookup(sym)==-1ULL){
+					DefIndexedSymbol(index,sym,env->mappings[i].obj);
+					env = (SlangEnv*)PeekArg();
+				}
+			}
+			if (!env->next) break;
+			env = env->next;
+			argStack.data[argStack.size-1] = (SlangHeader*)env;
+		}
+		PopArg();
+		return;
+	}
+	
 	while (true){
 		for (size_t i=0;i<env->header.varCount;++i){
 			SymbolName sym = env->mappings[i].sym;
@@ -6657,13 +8919,11 @@ inline bool CodeInterpreter::SlangOutputToFile(FILE* file,SlangHeader* obj){
 			break;
 		}
 		case SlangType::Int: {
-			SlangObj* intObj = (SlangObj*)obj;
-			fprintf(file,"%lld",intObj->integer);
+			fprintf(file,"%lld",GetInt(obj));
 			break;
 		}
 		case SlangType::Real: {
-			SlangObj* realObj = (SlangObj*)obj;
-			double real = realObj->real;
+			double real = GetReal(obj);
 			if (real==floor(real)&&abs(real)<1e16)
 				fprintf(file,"%.16g.0",real);
 			else
@@ -6727,8 +8987,7 @@ inline bool CodeInterpreter::SlangOutputToString(SlangStream* stream,SlangHeader
 			break;
 		}
 		case SlangType::Int: {
-			SlangObj* intObj = (SlangObj*)obj;
-			ssize_t size = snprintf(tempStr,sizeof(tempStr),"%lld",intObj->integer);
+			ssize_t size = snprintf(tempStr,sizeof(tempStr),"%lld",GetInt(obj));
 			assert(size!=-1);
 			stream = ReallocateStream(stream,size);
 			sstr = stream->str;
@@ -6741,9 +9000,8 @@ inline bool CodeInterpreter::SlangOutputToString(SlangStream* stream,SlangHeader
 			break;
 		}
 		case SlangType::Real: {
-			SlangObj* realObj = (SlangObj*)obj;
 			ssize_t size;
-			double real = realObj->real;
+			double real = GetReal(obj);
 			if (real==floor(real)&&abs(real)<1e16)
 				size = snprintf(tempStr,sizeof(tempStr),"%.16g.0",real);
 			else
@@ -6814,7 +9072,9 @@ void CodeInterpreter::SetGlobalSymbol(const std::string& name,SlangHeader* val){
 	SlangEnv* globalEnv = funcStack.data[0].env;
 	if (!globalEnv->SetSymbol(sym,val)){
 		DefEnvSymbol(globalEnv,sym,val);
+		return;
 	}
+	WriteBarrier(globalEnv,val);
 }
 
 bool CodeInterpreter::EvalCall(SlangHeader* codeObj){
@@ -6827,7 +9087,7 @@ bool CodeInterpreter::EvalCall(SlangHeader* codeObj){
 	
 	if (r){
 		size_t index = codeWriter.evalFuncIndex;
-		Call(index,funcStack.Back().env,false);
+		Call(index,funcStack.Back().env);
 	}
 	return r;
 }
@@ -6849,6 +9109,47 @@ struct PrintCodeData {
 	size_t pcLine = 0;
 };
 
+static const char* RegisterOpName(uint8_t op){
+	switch (op){
+		case SLANG_OP_REG_ADD:
+			return "REG ADD";
+		case SLANG_OP_REG_SUB:
+			return "REG SUB";
+		case SLANG_OP_REG_MUL:
+			return "REG MUL";
+		case SLANG_OP_REG_DIV:
+			return "REG DIV";
+		case SLANG_OP_REG_EQ:
+			return "REG EQ";
+		case SLANG_OP_REG_PAIR:
+			return "REG PAIR";
+		case SLANG_OP_REG_NOT:
+			return "REG NOT";
+		case SLANG_OP_REG_INC:
+			return "REG INC";
+		case SLANG_OP_REG_DEC:
+			return "REG DEC";
+		case SLANG_OP_REG_NEG:
+			return "REG NEG";
+		case SLANG_OP_REG_LEFT:
+			return "REG L";
+		case SLANG_OP_REG_RIGHT:
+			return "REG R";
+		default:
+			return "REG UNBOX";
+	}
+}
+
+// dst first, then the source registers
+static void PrintRegisters(std::ostream& os,const uint8_t* c,size_t count){
+	for (size_t i=0;i<count;++i){
+		uint16_t reg = *(uint16_t*)(c+OPCODE_SIZE+2*i);
+		os << 'r' << reg;
+		if (i+1<count)
+			os << ' ';
+	}
+}
+
 bool PrintCodeSub(const uint8_t* c,void* data){
 	SlangHeader* ptr;
 	SymbolName sym;
@@ -6900,16 +9201,10 @@ bool PrintCodeSub(const uint8_t* c,void* data){
 		case SLANG_OP_ONE:
 			dat->os << "PUSH ONE\n";
 			break;
-		case SLANG_OP_LOOKUP:
-			dat->os << "LOOKUP ";
-			sym = *(SymbolName*)(c+OPCODE_SIZE);
-			dat->os << gDebugParser->GetSymbolString(sym);
-			dat->os << '\n';
-			break;
-		case SLANG_OP_SET:
-			dat->os << "SET ";
-			sym = *(SymbolName*)(c+OPCODE_SIZE);
-			dat->os << gDebugParser->GetSymbolString(sym);
+		case SLANG_OP_GET_CAPTURE:
+			dat->os << "GETCAPTURE ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx;
 			dat->os << '\n';
 			break;
 		case SLANG_OP_GET_LOCAL:
@@ -6954,6 +9249,15 @@ bool PrintCodeSub(const uint8_t* c,void* data){
 			dat->os << big;
 			dat->os << '\n';
 			break;
+		case SLANG_OP_MAKE_BOX:
+			dat->os << "BOX\n";
+			break;
+		case SLANG_OP_UNBOX:
+			dat->os << "UNBOX\n";
+			break;
+		case SLANG_OP_SET_BOX:
+			dat->os << "SETBOX\n";
+			break;
 		case SLANG_OP_PUSH_FRAME:
 			dat->os << "PUSH FRAME\n";
 			break;
@@ -6962,12 +9266,14 @@ bool PrintCodeSub(const uint8_t* c,void* data){
 			lamIndex = *(uint64_t*)(c+OPCODE_SIZE);
 			dat->os << lamIndex << '\n';
 			break;
+		case SLANG_OP_MAKE_CLOSURE:
+			dat->os << "MAKE CLOSURE ";
+			lamIndex = *(uint64_t*)(c+OPCODE_SIZE);
+			dat->os << lamIndex << '\n';
+			break;
 		case SLANG_OP_POP_ARG:
 			dat->os << "POP\n";
 			break;
-		case SLANG_OP_INTERNAL_DEF:
-			dat->os << "INTERNAL DEF\n";
-			break;
 		case SLANG_OP_UNPACK:
 			dat->os << "UNPACK\n";
 			break;
@@ -7146,6 +9452,124 @@ bool PrintCodeSub(const uint8_t* c,void* data){
 				dat->os << "()";
 			dat->os << '\n';
 			break;
+		case SLANG_OP_GET_LOCAL2:
+			dat->os << "GETLOCAL2 ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx << ' ';
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE+2);
+			dat->os << localIdx << '\n';
+			break;
+		case SLANG_OP_PUSH_FRAME_LOCAL:
+			dat->os << "PUSH FRAME GETLOCAL ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx << '\n';
+			break;
+		case SLANG_OP_DEC_LOCAL:
+			dat->os << "DEC LOCAL ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx << '\n';
+			break;
+		case SLANG_OP_ADD_LOCALS:
+			dat->os << "ADD LOCALS ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx << ' ';
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE+2);
+			dat->os << localIdx << '\n';
+			break;
+		case SLANG_OP_REG_STORE:
+			dat->os << "REG STORE ";
+			PrintRegisters(dat->os,c,2);
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE+4);
+			dat->os << " TOP " << localIdx << '\n';
+			break;
+		case SLANG_OP_REG_ADD:
+		case SLANG_OP_REG_SUB:
+		case SLANG_OP_REG_MUL:
+		case SLANG_OP_REG_DIV:
+		case SLANG_OP_REG_EQ:
+		case SLANG_OP_REG_PAIR:
+			dat->os << RegisterOpName(*c) << ' ';
+			PrintRegisters(dat->os,c,3);
+			dat->os << '\n';
+			break;
+		case SLANG_OP_REG_NOT:
+		case SLANG_OP_REG_INC:
+		case SLANG_OP_REG_DEC:
+		case SLANG_OP_REG_NEG:
+		case SLANG_OP_REG_LEFT:
+		case SLANG_OP_REG_RIGHT:
+		case SLANG_OP_REG_UNBOX:
+			dat->os << RegisterOpName(*c) << ' ';
+			PrintRegisters(dat->os,c,2);
+			dat->os << '\n';
+			break;
+		case SLANG_OP_REG_CJUMP:
+		case SLANG_OP_REG_CNJUMP:
+			dat->os << ((*c==SLANG_OP_REG_CJUMP) ? "REG CJMP r" : "REG CNJMP r");
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE+4);
+			dat->os << localIdx << " TOP ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE+6);
+			dat->os << localIdx << ' ';
+			big = *(int32_t*)(c+OPCODE_SIZE);
+			big += dat->pos;
+			dat->os << big << '\n';
+			break;
+		case SLANG_OP_REG_RET:
+			dat->os << "REG RET ";
+			PrintRegisters(dat->os,c,1);
+			dat->os << '\n';
+			break;
+		case SLANG_OP_ADD_II:
+			dat->os << "ADD II ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx << '\n';
+			break;
+		case SLANG_OP_SUB_II:
+			dat->os << "SUB II ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx << '\n';
+			break;
+		case SLANG_OP_MUL_II:
+			dat->os << "MUL II ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx << '\n';
+			break;
+		case SLANG_OP_DIV_II:
+			dat->os << "DIV II ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx << '\n';
+			break;
+		case SLANG_OP_ADD_RR:
+			dat->os << "ADD RR ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx << '\n';
+			break;
+		case SLANG_OP_SUB_RR:
+			dat->os << "SUB RR ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx << '\n';
+			break;
+		case SLANG_OP_MUL_RR:
+			dat->os << "MUL RR ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx << '\n';
+			break;
+		case SLANG_OP_DIV_RR:
+			dat->os << "DIV RR ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE);
+			dat->os << localIdx << '\n';
+			break;
+		case SLANG_OP_JIT_ENTER:
+			dat->os << "JIT ENTER\n";
+			break;
+		case SLANG_OP_CJUMP_LOCAL:
+			dat->os << "LOCAL CJMP ";
+			localIdx = *(uint16_t*)(c+OPCODE_SIZE+4);
+			dat->os << localIdx << ' ';
+			big = *(int32_t*)(c+OPCODE_SIZE);
+			big += dat->pos;
+			dat->os << big << '\n';
+			break;
 		default:
 			dat->os << "??\n";
 			break;
@@ -7280,6 +9704,10 @@ void CodeInterpreter::ZeroDivisionError(){
 	PushError("ZeroDivisionError","Cannot divide by zero!");
 }
 
+void CodeInterpreter::MemoryError(){
+	PushError("MemoryError","Could not allocate storage!");
+}
+
 void CodeInterpreter::AssertError(){
 	PushError("AssertError","Assertion failed!");
 }
@@ -7345,8 +9773,7 @@ bool CodeFuncInc(CodeInterpreter* c){
 	SlangHeader* val = c->GetArg(0);
 	TYPE_CHECK_EXACT(val,SlangType::Int);
 	
-	SlangObj* res = c->alloc.MakeInt(((SlangObj*)val)->integer+1);
-	c->Return((SlangHeader*)res);
+	c->Return(c->alloc.MakeInt(GetInt(val)+1));
 	return true;
 }
 
@@ -7354,46 +9781,41 @@ bool CodeFuncDec(CodeInterpreter* c){
 	SlangHeader* val = c->GetArg(0);
 	TYPE_CHECK_EXACT(val,SlangType::Int);
 	
-	SlangObj* res = c->alloc.MakeInt(((SlangObj*)val)->integer-1);
-	c->Return((SlangHeader*)res);
+	c->Return(c->alloc.MakeInt(GetInt(val)-1));
 	return true;
 }
 
+inline void ReturnNumeric(CodeInterpreter* c,bool isReal,int64_t i,double r){
+	if (isReal)
+		c->Return(c->alloc.MakeReal(r));
+	else
+		c->Return(c->alloc.MakeInt(i));
+}
+
 bool CodeFuncAdd(CodeInterpreter* c){
 	size_t count = c->GetArgCount();
-	if (!count){
-		c->Return((SlangHeader*)c->alloc.MakeInt(0));
-		return true;
-	}
-	SlangObj* res;
+	int64_t intRes = 0;
+	double realRes = 0.0;
 	bool isReal = false;
-	if (GetType(c->GetArg(0))==SlangType::Real){
-		res = c->alloc.MakeReal(0.0);
-		isReal = true;
-	} else {
-		res = c->alloc.MakeInt(0);
-	}
 	for (size_t i=0;i<count;++i){
 		SlangHeader* h = c->GetArg(i);
 		TYPE_CHECK_NUMERIC(h);
-		SlangObj* obj = (SlangObj*)h;
 		
-		if (h->type==SlangType::Real){
+		if (GetType(h)==SlangType::Real){
 			if (!isReal){
-				res = c->alloc.MakeReal(res->integer);
-				obj = (SlangObj*)c->GetArg(i);
+				realRes = intRes;
 				isReal = true;
 			}
-			res->real += obj->real;
+			realRes += GetReal(h);
 		} else {
 			if (isReal){
-				res->real += obj->integer;
+				realRes += GetInt(h);
 			} else {
-				res->integer += obj->integer;
+				intRes += GetInt(h);
 			}
 		}
 	}
-	c->Return((SlangHeader*)res);
+	ReturnNumeric(c,isReal,intRes,realRes);
 	return true;
 }
 
@@ -7402,85 +9824,72 @@ bool CodeFuncSub(CodeInterpreter* c){
 	if (count==1){
 		SlangHeader* first = c->GetArg(0);
 		TYPE_CHECK_NUMERIC(first);
-		if (first->type==SlangType::Real){
-			c->Return((SlangHeader*)c->alloc.MakeReal(-((SlangObj*)first)->real));
+		if (GetType(first)==SlangType::Real){
+			c->Return(c->alloc.MakeReal(-GetReal(first)));
 		} else {
-			c->Return((SlangHeader*)c->alloc.MakeInt(-((SlangObj*)first)->integer));
+			c->Return(c->alloc.MakeInt(-GetInt(first)));
 		}
 		return true;
 	}
 	
-	SlangObj* res;
+	int64_t intRes = 0;
+	double realRes = 0.0;
 	bool isReal = false;
 	SlangHeader* first = c->GetArg(0);
 	TYPE_CHECK_NUMERIC(first);
 	
-	SlangObj* firstObj = (SlangObj*)first;
-	if (first->type==SlangType::Real){
-		res = c->alloc.MakeReal(firstObj->real);
+	if (GetType(first)==SlangType::Real){
+		realRes = GetReal(first);
 		isReal = true;
 	} else {
-		res = c->alloc.MakeInt(firstObj->integer);
+		intRes = GetInt(first);
 	}
 	for (size_t i=1;i<count;++i){
 		SlangHeader* h = c->GetArg(i);
 		TYPE_CHECK_NUMERIC(h);
-		SlangObj* obj = (SlangObj*)h;
 		
-		if (h->type==SlangType::Real){
+		if (GetType(h)==SlangType::Real){
 			if (!isReal){
-				res = c->alloc.MakeReal(res->integer);
-				obj = (SlangObj*)c->GetArg(i);
+				realRes = intRes;
 				isReal = true;
 			}
-			res->real -= obj->real;
+			realRes -= GetReal(h);
 		} else {
 			if (isReal){
-				res->real -= obj->integer;
+				realRes -= GetInt(h);
 			} else {
-				res->integer -= obj->integer;
+				intRes -= GetInt(h);
 			}
 		}
 	}
-	c->Return((SlangHeader*)res);
+	ReturnNumeric(c,isReal,intRes,realRes);
 	return true;
 }
 
 bool CodeFuncMul(CodeInterpreter* c){
 	size_t count = c->GetArgCount();
-	if (!count){
-		c->Return((SlangHeader*)c->alloc.MakeInt(1));
-		return true;
-	}
-	SlangObj* res;
+	int64_t intRes = 1;
+	double realRes = 1.0;
 	bool isReal = false;
-	if (GetType(c->GetArg(0))==SlangType::Real){
-		res = c->alloc.MakeReal(1.0);
-		isReal = true;
-	} else {
-		res = c->alloc.MakeInt(1);
-	}
 	for (size_t i=0;i<count;++i){
 		SlangHeader* h = c->GetArg(i);
 		TYPE_CHECK_NUMERIC(h);
-		SlangObj* obj = (SlangObj*)h;
 		
-		if (h->type==SlangType::Real){
+		if (GetType(h)==SlangType::Real){
 			if (!isReal){
-				res = c->alloc.MakeReal(res->integer);
-				obj = (SlangObj*)c->GetArg(i);
+				realRes = intRes;
 				isReal = true;
 			}
-			res->real *= obj->real;
+			realRes *= GetReal(h);
 		} else {
 			if (isReal){
-				res->real *= obj->integer;
+				realRes *= GetInt(h);
 			} else {
-				res->integer *= obj->integer;
+				intRes *= GetInt(h);
 			}
 		}
 	}
-	c->Return((SlangHeader*)res);
+	ReturnNumeric(c,isReal,intRes,realRes);
 	return true;
 }
 
@@ -7489,64 +9898,64 @@ bool CodeFuncDiv(CodeInterpreter* c){
 	if (count==1){
 		SlangHeader* first = c->GetArg(0);
 		TYPE_CHECK_NUMERIC(first);
-		if (first->type==SlangType::Real){
-			double real = ((SlangObj*)first)->real;
+		if (GetType(first)==SlangType::Real){
+			double real = GetReal(first);
 			if (real==0.0){
 				c->ZeroDivisionError();
 				return false;
 			}
-			c->Return((SlangHeader*)c->alloc.MakeReal(1.0/real));
+			c->Return(c->alloc.MakeReal(1.0/real));
 		} else {
-			int64_t integer = ((SlangObj*)first)->integer;
+			int64_t integer = GetInt(first);
 			if (integer==0){
 				c->ZeroDivisionError();
 				return false;
 			}
-			c->Return((SlangHeader*)c->alloc.MakeInt(floordiv(1,integer)));
+			c->Return(c->alloc.MakeInt(floordiv(1,integer)));
 		}
 		return true;
 	}
 	
-	SlangObj* res;
+	int64_t intRes = 0;
+	double realRes = 0.0;
 	bool isReal = false;
 	SlangHeader* first = c->GetArg(0);
 	TYPE_CHECK_NUMERIC(first);
-	SlangObj* firstObj = (SlangObj*)first;
-	if (first->type==SlangType::Real){
-		res = c->alloc.MakeReal(firstObj->real);
+	if (GetType(first)==SlangType::Real){
+		realRes = GetReal(first);
 		isReal = true;
 	} else {
-		res = c->alloc.MakeInt(firstObj->integer);
+		intRes = GetInt(first);
 	}
 	for (size_t i=1;i<count;++i){
 		SlangHeader* h = c->GetArg(i);
 		TYPE_CHECK_NUMERIC(h);
-		SlangObj* obj = (SlangObj*)h;
 		
-		if (h->type==SlangType::Real){
+		if (GetType(h)==SlangType::Real){
 			if (!isReal){
-				res = c->alloc.MakeReal(res->integer);
-				obj = (SlangObj*)c->GetArg(i);
+				realRes = intRes;
 				isReal = true;
 			}
-			if (obj->real==0.0){
+			double real = GetReal(h);
+			if (real==0.0){
 				c->ZeroDivisionError();
 				return false;
 			}
-			res->real /= obj->real;
+			realRes /= real;
 		} else {
-			if (obj->integer==0){
+			int64_t integer = GetInt(h);
+			if (integer==0){
 				c->ZeroDivisionError();
 				return false;
 			}
 			if (isReal){
-				res->real /= obj->integer;
+				realRes /= integer;
 			} else {
-				res->integer = floordiv(res->integer,obj->integer);
+				intRes = floordiv(intRes,integer);
 			}
 		}
 	}
-	c->Return((SlangHeader*)res);
+	ReturnNumeric(c,isReal,intRes,realRes);
 	return true;
 }
 
@@ -7554,28 +9963,25 @@ bool CodeFuncMod(CodeInterpreter* c){
 	SlangHeader* lObj = c->GetArg(0);
 	SlangHeader* rObj = c->GetArg(1);
 	
-	SlangObj* l = (SlangObj*)lObj;
-	SlangObj* r = (SlangObj*)rObj;
-	
 	if (GetType(lObj)==SlangType::Int){
 		if (GetType(rObj)==SlangType::Int){
-			if (r->integer==0){
+			if (GetInt(rObj)==0){
 				c->ZeroDivisionError();
 				return false;
 			}
 			
-			c->Return((SlangHeader*)c->alloc.MakeInt(
-				floormod(l->integer,r->integer)
+			c->Return(c->alloc.MakeInt(
+				floormod(GetInt(lObj),GetInt(rObj))
 			));
 			return true;
 		} else if (GetType(rObj)==SlangType::Real){
-			if (r->real==0.0){
+			if (GetReal(rObj)==0.0){
 				c->ZeroDivisionError();
 				return false;
 			}
 			
-			c->Return((SlangHeader*)c->alloc.MakeReal(
-				floorfmod((double)l->integer,r->real)
+			c->Return(c->alloc.MakeReal(
+				floorfmod((double)GetInt(lObj),GetReal(rObj))
 			));
 			return true;
 		} else {
@@ -7584,23 +9990,23 @@ bool CodeFuncMod(CodeInterpreter* c){
 		}
 	} else if (GetType(lObj)==SlangType::Real){
 		if (GetType(rObj)==SlangType::Int){
-			if (r->integer==0){
+			if (GetInt(rObj)==0){
 				c->ZeroDivisionError();
 				return false;
 			}
 		
-			c->Return((SlangHeader*)c->alloc.MakeReal(
-				floorfmod(l->real,(double)r->integer)
+			c->Return(c->alloc.MakeReal(
+				floorfmod(GetReal(lObj),(double)GetInt(rObj))
 			));
 			return true;
 		} else if (GetType(rObj)==SlangType::Real){
-			if (r->real==0.0){
+			if (GetReal(rObj)==0.0){
 				c->ZeroDivisionError();
 				return false;
 			}
 		
-			c->Return((SlangHeader*)c->alloc.MakeReal(
-				floorfmod(l->real,r->real)
+			c->Return(c->alloc.MakeReal(
+				floorfmod(GetReal(lObj),GetReal(rObj))
 			));
 			return true;
 		} else {
@@ -7617,29 +10023,26 @@ bool CodeFuncPow(CodeInterpreter* c){
 	SlangHeader* lObj = c->GetArg(0);
 	SlangHeader* rObj = c->GetArg(1);
 	
-	SlangObj* l = (SlangObj*)lObj;
-	SlangObj* r = (SlangObj*)rObj;
-	
 	if (GetType(lObj)==SlangType::Int){
 		if (GetType(rObj)==SlangType::Int){
-			if (r->integer>=0){
-				c->Return((SlangHeader*)c->alloc.MakeInt(intpow(l->integer,(uint64_t)r->integer)));
+			if (GetInt(rObj)>=0){
+				c->Return(c->alloc.MakeInt(intpow(GetInt(lObj),(uint64_t)GetInt(rObj))));
 				return true;
 			} else {
-				if (l->integer==0){
+				if (GetInt(lObj)==0){
 					c->ZeroDivisionError();
 					return false;
 				}
 				
-				c->Return((SlangHeader*)c->alloc.MakeReal(pow((double)l->integer,(double)r->integer)));
+				c->Return(c->alloc.MakeReal(pow((double)GetInt(lObj),(double)GetInt(rObj))));
 				return true;
 			}
 		} else if (GetType(rObj)==SlangType::Real){
-			if (l->integer==0&&r->real<0.0){
+			if (GetInt(lObj)==0&&GetReal(rObj)<0.0){
 				c->ZeroDivisionError();
 				return false;
 			}
-			c->Return((SlangHeader*)c->alloc.MakeReal(pow((double)l->integer,r->real)));
+			c->Return(c->alloc.MakeReal(pow((double)GetInt(lObj),GetReal(rObj))));
 			return true;
 		} else {
 			c->TypeError2(GetType(rObj),SlangType::Int,SlangType::Real);
@@ -7647,18 +10050,18 @@ bool CodeFuncPow(CodeInterpreter* c){
 		}
 	} else if (GetType(lObj)==SlangType::Real){
 		if (GetType(rObj)==SlangType::Int){
-			if (l->real==0.0&&r->integer<0){
+			if (GetReal(lObj)==0.0&&GetInt(rObj)<0){
 				c->ZeroDivisionError();
 				return false;
 			}
-			c->Return((SlangHeader*)c->alloc.MakeReal(pow(l->real,(double)r->integer)));
+			c->Return(c->alloc.MakeReal(pow(GetReal(lObj),(double)GetInt(rObj))));
 			return true;
 		} else if (GetType(rObj)==SlangType::Real){
-			if (l->real==0.0&&r->real<0){
+			if (GetReal(lObj)==0.0&&GetReal(rObj)<0){
 				c->ZeroDivisionError();
 				return false;
 			}
-			c->Return((SlangHeader*)c->alloc.MakeReal(pow(l->real,r->real)));
+			c->Return(c->alloc.MakeReal(pow(GetReal(lObj),GetReal(rObj))));
 			return true;
 		} else {
 			c->TypeError2(GetType(rObj),SlangType::Int,SlangType::Real);
@@ -7674,20 +10077,20 @@ bool CodeFuncAbs(CodeInterpreter* c){
 	SlangHeader* arg = c->GetArg(0);
 	
 	if (GetType(arg)==SlangType::Int){
-		if (((SlangObj*)arg)->integer>=0)
+		if (GetInt(arg)>=0)
 			c->Return(arg);
 		else
 			c->Return(
-				(SlangHeader*)c->alloc.MakeInt(-((SlangObj*)arg)->integer)
+				c->alloc.MakeInt(-GetInt(arg))
 			);
 		
 		return true;
 	} else if (GetType(arg)==SlangType::Real){
-		if (((SlangObj*)arg)->real>0.0)
+		if (GetReal(arg)>0.0)
 			c->Return(arg);
 		else
 			c->Return(
-				(SlangHeader*)c->alloc.MakeReal(abs(((SlangObj*)arg)->real))
+				c->alloc.MakeReal(abs(GetReal(arg)))
 			);
 			
 		return true;
@@ -7705,7 +10108,7 @@ bool CodeFuncFloor(CodeInterpreter* c){
 		return true;
 	} else if (GetType(arg)==SlangType::Real){
 		c->Return(
-			(SlangHeader*)c->alloc.MakeInt(floor(((SlangObj*)arg)->real))
+			c->alloc.MakeInt(floor(GetReal(arg)))
 		);
 		return true;
 	} else {
@@ -7722,7 +10125,7 @@ bool CodeFuncCeil(CodeInterpreter* c){
 		return true;
 	} else if (GetType(arg)==SlangType::Real){
 		c->Return(
-			(SlangHeader*)c->alloc.MakeInt(ceil(((SlangObj*)arg)->real))
+			c->alloc.MakeInt(ceil(GetReal(arg)))
 		);
 		return true;
 	} else {
@@ -7735,19 +10138,18 @@ bool CodeFuncMin(CodeInterpreter* c){
 	size_t argCount = c->GetArgCount();
 	SlangHeader* first = c->GetArg(0);
 	TYPE_CHECK_NUMERIC(first);
-	SlangObj* res = (SlangObj*)first;
+	SlangHeader* res = first;
 	
 	for (size_t i=1;i<argCount;++i){
 		SlangHeader* h = c->GetArg(i);
-		SlangObj* hObj = (SlangObj*)h;
-		if (res->header.type==SlangType::Int){
+		if (GetType(res)==SlangType::Int){
 			if (GetType(h)==SlangType::Int){
-				if (res->integer>hObj->integer){
-					res = hObj;
+				if (GetInt(res)>GetInt(h)){
+					res = h;
 				}
 			} else if (GetType(h)==SlangType::Real){
-				if ((double)res->integer>hObj->real){
-					res = hObj;
+				if ((double)GetInt(res)>GetReal(h)){
+					res = h;
 				}
 			} else {
 				c->TypeError2(GetType(h),SlangType::Int,SlangType::Real);
@@ -7755,12 +10157,12 @@ bool CodeFuncMin(CodeInterpreter* c){
 			}
 		} else {
 			if (GetType(h)==SlangType::Int){
-				if (res->real>(double)hObj->integer){
-					res = hObj;
+				if (GetReal(res)>(double)GetInt(h)){
+					res = h;
 				}
 			} else if (GetType(h)==SlangType::Real){
-				if (res->real>hObj->real){
-					res = hObj;
+				if (GetReal(res)>GetReal(h)){
+					res = h;
 				}
 			} else {
 				c->TypeError2(GetType(h),SlangType::Int,SlangType::Real);
@@ -7769,7 +10171,7 @@ bool CodeFuncMin(CodeInterpreter* c){
 		}
 	}
 	
-	c->Return((SlangHeader*)res);
+	c->Return(res);
 	return true;
 }
 
@@ -7777,19 +10179,18 @@ bool CodeFuncMax(CodeInterpreter* c){
 	size_t argCount = c->GetArgCount();
 	SlangHeader* first = c->GetArg(0);
 	TYPE_CHECK_NUMERIC(first);
-	SlangObj* res = (SlangObj*)first;
+	SlangHeader* res = first;
 	
 	for (size_t i=1;i<argCount;++i){
 		SlangHeader* h = c->GetArg(i);
-		SlangObj* hObj = (SlangObj*)h;
-		if (res->header.type==SlangType::Int){
+		if (GetType(res)==SlangType::Int){
 			if (GetType(h)==SlangType::Int){
-				if (res->integer<hObj->integer){
-					res = hObj;
+				if (GetInt(res)<GetInt(h)){
+					res = h;
 				}
 			} else if (GetType(h)==SlangType::Real){
-				if ((double)res->integer<hObj->real){
-					res = hObj;
+				if ((double)GetInt(res)<GetReal(h)){
+					res = h;
 				}
 			} else {
 				c->TypeError2(GetType(h),SlangType::Int,SlangType::Real);
@@ -7797,12 +10198,12 @@ bool CodeFuncMax(CodeInterpreter* c){
 			}
 		} else {
 			if (GetType(h)==SlangType::Int){
-				if (res->real<(double)hObj->integer){
-					res = hObj;
+				if (GetReal(res)<(double)GetInt(h)){
+					res = h;
 				}
 			} else if (GetType(h)==SlangType::Real){
-				if (res->real<hObj->real){
-					res = hObj;
+				if (GetReal(res)<GetReal(h)){
+					res = h;
 				}
 			} else {
 				c->TypeError2(GetType(h),SlangType::Int,SlangType::Real);
@@ -7811,7 +10212,7 @@ bool CodeFuncMax(CodeInterpreter* c){
 		}
 	}
 	
-	c->Return((SlangHeader*)res);
+	c->Return(res);
 	return true;
 }
 
@@ -7822,10 +10223,10 @@ bool CodeFuncBitAnd(CodeInterpreter* c){
 	for (size_t i=0;i<argCount;++i){
 		SlangHeader* arg = c->GetArg(i);
 		TYPE_CHECK_EXACT(arg,SlangType::Int);
-		v &= (uint64_t)((SlangObj*)arg)->integer;
+		v &= (uint64_t)GetInt(arg);
 	}
 	
-	c->Return((SlangHeader*)c->alloc.MakeInt(v));
+	c->Return(c->alloc.MakeInt(v));
 	return true;
 }
 
@@ -7836,10 +10237,10 @@ bool CodeFuncBitOr(CodeInterpreter* c){
 	for (size_t i=0;i<argCount;++i){
 		SlangHeader* arg = c->GetArg(i);
 		TYPE_CHECK_EXACT(arg,SlangType::Int);
-		v |= (uint64_t)((SlangObj*)arg)->integer;
+		v |= (uint64_t)GetInt(arg);
 	}
 	
-	c->Return((SlangHeader*)c->alloc.MakeInt(v));
+	c->Return(c->alloc.MakeInt(v));
 	return true;
 }
 
@@ -7850,10 +10251,10 @@ bool CodeFuncBitXor(CodeInterpreter* c){
 	for (size_t i=0;i<argCount;++i){
 		SlangHeader* arg = c->GetArg(i);
 		TYPE_CHECK_EXACT(arg,SlangType::Int);
-		v ^= (uint64_t)((SlangObj*)arg)->integer;
+		v ^= (uint64_t)GetInt(arg);
 	}
 	
-	c->Return((SlangHeader*)c->alloc.MakeInt(v));
+	c->Return(c->alloc.MakeInt(v));
 	return true;
 }
 
@@ -7861,8 +10262,8 @@ bool CodeFuncBitNot(CodeInterpreter* c){
 	SlangHeader* arg = c->GetArg(0);
 	
 	TYPE_CHECK_EXACT(arg,SlangType::Int);
-	uint64_t val = ((SlangObj*)arg)->integer;
-	c->Return((SlangHeader*)c->alloc.MakeInt(~val));
+	uint64_t val = GetInt(arg);
+	c->Return(c->alloc.MakeInt(~val));
 	return true;
 }
 
@@ -7872,8 +10273,8 @@ bool CodeFuncBitLeftShift(CodeInterpreter* c){
 	TYPE_CHECK_EXACT(arg,SlangType::Int);
 	TYPE_CHECK_EXACT(shift,SlangType::Int);
 	
-	uint64_t val = ((SlangObj*)arg)->integer;
-	int64_t s = ((SlangObj*)shift)->integer;
+	uint64_t val = GetInt(arg);
+	int64_t s = GetInt(shift);
 	if (s==0){
 		c->Return(arg);
 		return true;
@@ -7884,13 +10285,13 @@ bool CodeFuncBitLeftShift(CodeInterpreter* c){
 	}
 	if (s<0){
 		c->Return(
-			(SlangHeader*)c->alloc.MakeInt(val>>(-s))
+			c->alloc.MakeInt(val>>(-s))
 		);
 		return true;
 	}
 	
 	c->Return(
-		(SlangHeader*)c->alloc.MakeInt(val<<s)
+		c->alloc.MakeInt(val<<s)
 	);
 	return true;
 }
@@ -7901,8 +10302,8 @@ bool CodeFuncBitRightShift(CodeInterpreter* c){
 	TYPE_CHECK_EXACT(arg,SlangType::Int);
 	TYPE_CHECK_EXACT(shift,SlangType::Int);
 	
-	uint64_t val = ((SlangObj*)arg)->integer;
-	int64_t s = ((SlangObj*)shift)->integer;
+	uint64_t val = GetInt(arg);
+	int64_t s = GetInt(shift);
 	if (s==0){
 		c->Return(arg);
 		return true;
@@ -7913,13 +10314,13 @@ bool CodeFuncBitRightShift(CodeInterpreter* c){
 	}
 	if (s<0){
 		c->Return(
-			(SlangHeader*)c->alloc.MakeInt(val<<(-s))
+			c->alloc.MakeInt(val<<(-s))
 		);
 		return true;
 	}
 	
 	c->Return(
-		(SlangHeader*)c->alloc.MakeInt(val>>s)
+		c->alloc.MakeInt(val>>s)
 	);
 	return true;
 }
@@ -7933,22 +10334,18 @@ bool CodeFuncGT(CodeInterpreter* c){
 	
 	SlangHeader* lObj;
 	SlangHeader* rObj = c->GetArg(0);
-	SlangObj* l;
-	SlangObj* r;
 	
 	for (size_t i=1;i<argCount;++i){
 		lObj = rObj;
 		rObj = c->GetArg(i);
-		l = (SlangObj*)lObj;
-		r = (SlangObj*)rObj;
 		if (GetType(lObj)==SlangType::Int){
 			if (GetType(rObj)==SlangType::Int){
-				if (!(l->integer>r->integer)){
+				if (!(GetInt(lObj)>GetInt(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
 			} else if (GetType(rObj)==SlangType::Real){
-				if (!((double)l->integer>r->real)){
+				if (!((double)GetInt(lObj)>GetReal(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
@@ -7958,12 +10355,12 @@ bool CodeFuncGT(CodeInterpreter* c){
 			}
 		} else if (GetType(lObj)==SlangType::Real){
 			if (GetType(rObj)==SlangType::Int){
-				if (!(l->real>(double)r->integer)){
+				if (!(GetReal(lObj)>(double)GetInt(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
 			} else if (GetType(rObj)==SlangType::Real){
-				if (!(l->real>r->real)){
+				if (!(GetReal(lObj)>GetReal(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
@@ -7990,22 +10387,18 @@ bool CodeFuncLT(CodeInterpreter* c){
 	
 	SlangHeader* lObj;
 	SlangHeader* rObj = c->GetArg(0);
-	SlangObj* l;
-	SlangObj* r;
 	
 	for (size_t i=1;i<argCount;++i){
 		lObj = rObj;
 		rObj = c->GetArg(i);
-		l = (SlangObj*)lObj;
-		r = (SlangObj*)rObj;
 		if (GetType(lObj)==SlangType::Int){
 			if (GetType(rObj)==SlangType::Int){
-				if (!(l->integer<r->integer)){
+				if (!(GetInt(lObj)<GetInt(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
 			} else if (GetType(rObj)==SlangType::Real){
-				if (!((double)l->integer<r->real)){
+				if (!((double)GetInt(lObj)<GetReal(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
@@ -8015,12 +10408,12 @@ bool CodeFuncLT(CodeInterpreter* c){
 			}
 		} else if (GetType(lObj)==SlangType::Real){
 			if (GetType(rObj)==SlangType::Int){
-				if (!(l->real<(double)r->integer)){
+				if (!(GetReal(lObj)<(double)GetInt(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
 			} else if (GetType(rObj)==SlangType::Real){
-				if (!(l->real<r->real)){
+				if (!(GetReal(lObj)<GetReal(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
@@ -8047,22 +10440,18 @@ bool CodeFuncGTE(CodeInterpreter* c){
 	
 	SlangHeader* lObj;
 	SlangHeader* rObj = c->GetArg(0);
-	SlangObj* l;
-	SlangObj* r;
 	
 	for (size_t i=1;i<argCount;++i){
 		lObj = rObj;
 		rObj = c->GetArg(i);
-		l = (SlangObj*)lObj;
-		r = (SlangObj*)rObj;
 		if (GetType(lObj)==SlangType::Int){
 			if (GetType(rObj)==SlangType::Int){
-				if (!(l->integer>=r->integer)){
+				if (!(GetInt(lObj)>=GetInt(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
 			} else if (GetType(rObj)==SlangType::Real){
-				if (!((double)l->integer>=r->real)){
+				if (!((double)GetInt(lObj)>=GetReal(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
@@ -8072,12 +10461,12 @@ bool CodeFuncGTE(CodeInterpreter* c){
 			}
 		} else if (GetType(lObj)==SlangType::Real){
 			if (GetType(rObj)==SlangType::Int){
-				if (!(l->real>=(double)r->integer)){
+				if (!(GetReal(lObj)>=(double)GetInt(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
 			} else if (GetType(rObj)==SlangType::Real){
-				if (!(l->real>=r->real)){
+				if (!(GetReal(lObj)>=GetReal(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
@@ -8104,22 +10493,18 @@ bool CodeFuncLTE(CodeInterpreter* c){
 	
 	SlangHeader* lObj;
 	SlangHeader* rObj = c->GetArg(0);
-	SlangObj* l;
-	SlangObj* r;
 	
 	for (size_t i=1;i<argCount;++i){
 		lObj = rObj;
 		rObj = c->GetArg(i);
-		l = (SlangObj*)lObj;
-		r = (SlangObj*)rObj;
 		if (GetType(lObj)==SlangType::Int){
 			if (GetType(rObj)==SlangType::Int){
-				if (!(l->integer<=r->integer)){
+				if (!(GetInt(lObj)<=GetInt(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
 			} else if (GetType(rObj)==SlangType::Real){
-				if (!((double)l->integer<=r->real)){
+				if (!((double)GetInt(lObj)<=GetReal(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
@@ -8129,12 +10514,12 @@ bool CodeFuncLTE(CodeInterpreter* c){
 			}
 		} else if (GetType(lObj)==SlangType::Real){
 			if (GetType(rObj)==SlangType::Int){
-				if (!(l->real<=(double)r->integer)){
+				if (!(GetReal(lObj)<=(double)GetInt(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
 			} else if (GetType(rObj)==SlangType::Real){
-				if (!(l->real<=r->real)){
+				if (!(GetReal(lObj)<=GetReal(rObj))){
 					c->Return(c->codeWriter.constFalseObj);
 					return true;
 				}
@@ -8285,7 +10670,7 @@ bool CodeFuncLen(CodeInterpreter* c){
 			if (!v->storage)
 				c->Return(c->codeWriter.constZeroObj);
 			else
-				c->Return((SlangHeader*)c->alloc.MakeInt(v->storage->size));
+				c->Return(c->alloc.MakeInt(v->storage->size));
 			return true;
 		}
 		case SlangType::Dict: {
@@ -8293,7 +10678,7 @@ bool CodeFuncLen(CodeInterpreter* c){
 			if (!d->table)
 				c->Return(c->codeWriter.constZeroObj);
 			else
-				c->Return((SlangHeader*)c->alloc.MakeInt(d->table->size));
+				c->Return(c->alloc.MakeInt(d->table->size));
 			return true;
 		}
 		case SlangType::String: {
@@ -8301,7 +10686,7 @@ bool CodeFuncLen(CodeInterpreter* c){
 			if (!str->storage)
 				c->Return(c->codeWriter.constZeroObj);
 			else
-				c->Return((SlangHeader*)c->alloc.MakeInt(str->storage->size));
+				c->Return(c->alloc.MakeInt(str->storage->size));
 			return true;
 		}
 		case SlangType::Maybe: {
@@ -8312,7 +10697,15 @@ bool CodeFuncLen(CodeInterpreter* c){
 			return true;
 		}
 		case SlangType::List: {
-			c->Return((SlangHeader*)c->alloc.MakeInt(GetArgCount((SlangList*)obj)));
+			c->Return(c->alloc.MakeInt(GetArgCount((SlangList*)obj)));
+			return true;
+		}
+		case SlangType::Iterator: {
+			c->Return(c->alloc.MakeInt(((SlangIter*)obj)->count));
+			return true;
+		}
+		case SlangType::Packed: {
+			c->Return(c->alloc.MakeInt(((SlangPacked*)obj)->GetLength()));
 			return true;
 		}
 		default:
@@ -8385,6 +10778,20 @@ bool CodeFuncEmpty(CodeInterpreter* c){
 				c->Return(c->codeWriter.constTrueObj);
 			return true;
 		}
+		case SlangType::Iterator: {
+			if (((SlangIter*)obj)->count)
+				c->Return(c->codeWriter.constFalseObj);
+			else
+				c->Return(c->codeWriter.constTrueObj);
+			return true;
+		}
+		case SlangType::Packed: {
+			if (((SlangPacked*)obj)->GetLength())
+				c->Return(c->codeWriter.constFalseObj);
+			else
+				c->Return(c->codeWriter.constTrueObj);
+			return true;
+		}
 		case SlangType::NullType: {
 			c->Return(c->codeWriter.constTrueObj);
 			return true;
@@ -8434,35 +10841,179 @@ bool CodeFuncForeach(CodeInterpreter* c);
 bool CodeFuncFilter(CodeInterpreter* c);
 bool CodeFuncFold(CodeInterpreter* c);
 
-#define RANGE_PATTERN() \
-	if (c->argStack.data[itIndex]){ \
-		SlangList* newL = c->alloc.AllocateList(); \
-		((SlangList*)c->argStack.data[itIndex])->right = (SlangHeader*)newL; \
-		c->argStack.data[itIndex] = (SlangHeader*)newL; \
-	} else { \
-		c->argStack.data[headIndex] = (SlangHeader*)c->alloc.AllocateList(); \
-		c->argStack.data[itIndex] = c->argStack.data[headIndex]; \
-	} \
-	SlangObj* intObj = c->alloc.MakeInt(i); \
-	listIt = (SlangList*)c->argStack.data[itIndex]; \
-	listIt->left = (SlangHeader*)intObj;
+// swaps the iterable in argStack slot idx for a private cursor, so
+// walking it never changes what user code holds
+inline bool CodeInterpreter::MakeCursor(size_t idx){
+	uint8_t kind;
+	switch (GetType(argStack.data[idx])){
+		case SlangType::Iterator:
+			kind = ITER_RANGE_CURSOR;
+			break;
+		case SlangType::Vector:
+			kind = ITER_VEC_CURSOR;
+			break;
+		case SlangType::String:
+			kind = ITER_STR_CURSOR;
+			break;
+		case SlangType::Dict:
+			kind = ITER_DICT_CURSOR;
+			break;
+		case SlangType::Packed:
+			kind = ITER_PACKED_CURSOR;
+			break;
+		default:
+			return false;
+	}
+	
+	SlangIter* cursor = alloc.AllocateIter(kind);
+	SlangHeader* obj = argStack.data[idx];
+	if (kind==ITER_RANGE_CURSOR){
+		SlangIter* range = (SlangIter*)obj;
+		cursor->pos = range->pos;
+		cursor->step = range->step;
+		cursor->count = range->count;
+	} else {
+		cursor->source = obj;
+	}
+	argStack.data[idx] = (SlangHeader*)cursor;
+	return true;
+}
 
-bool CodeFuncRange(CodeInterpreter* c){
+// the cursor is advanced before allocating, so it only has
+// to be reread from its slot afterwards
+bool CodeInterpreter::CursorNext(size_t idx){
+	SlangHeader* obj = argStack.data[idx];
+	if (GetType(obj)!=SlangType::Iterator||obj->iterKind==ITER_RANGE){
+		if (!MakeCursor(idx))
+			return false;
+		obj = argStack.data[idx];
+	}
+	
+	SlangIter* it = (SlangIter*)obj;
+	switch (it->header.iterKind){
+		case ITER_RANGE_CURSOR: {
+			if (!it->count)
+				return false;
+			int64_t i = it->pos;
+			it->pos += it->step;
+			--it->count;
+			PushArg(alloc.MakeInt(i));
+			return true;
+		}
+		case ITER_VEC_CURSOR: {
+			SlangStorage* storage = ((SlangVec*)it->source)->storage;
+			if (it->pos>=(int64_t)GetStorageSize(storage))
+				return false;
+			PushArg(storage->objs[it->pos++]);
+			return true;
+		}
+		case ITER_STR_CURSOR: {
+			if (it->pos>=(int64_t)GetStorageSize(((SlangStr*)it->source)->storage))
+				return false;
+			++it->pos;
+			SlangStr* ch = alloc.AllocateStr(1);
+			it = (SlangIter*)argStack.data[idx];
+			ch->storage->data[0] = ((SlangStr*)it->source)->storage->data[it->pos-1];
+			PushArg((SlangHeader*)ch);
+			return true;
+		}
+		case ITER_DICT_CURSOR: {
+			SlangStorage* storage = ((SlangDict*)it->source)->storage;
+			int64_t size = GetStorageSize(storage);
+			while (it->pos<size&&(uint64_t)storage->elements[it->pos].key==DICT_UNOCCUPIED_VAL)
+				++it->pos;
+			if (it->pos>=size)
+				return false;
+			++it->pos;
+			SlangList* entry = alloc.AllocateList();
+			it = (SlangIter*)argStack.data[idx];
+			SlangDictElement* elem = &((SlangDict*)it->source)->storage->elements[it->pos-1];
+			entry->left = elem->key;
+			entry->right = elem->val;
+			PushArg((SlangHeader*)entry);
+			return true;
+		}
+		case ITER_PACKED_CURSOR: {
+			if (it->pos>=(int64_t)((SlangPacked*)it->source)->GetLength())
+				return false;
+			++it->pos;
+			PushArg(PackedGet(alloc,(SlangPacked*)it->source,it->pos-1));
+			return true;
+		}
+	}
+	return false;
+}
+
+// pushes the next item of the iterable in argStack slot idx,
+// false once it's used up
+inline bool CodeInterpreter::IterNext(size_t idx){
+	SlangHeader* obj = argStack.data[idx];
+	if (GetType(obj)==SlangType::List){
+		PushArg(((SlangList*)obj)->left);
+		argStack.data[idx] = ((SlangList*)obj)->right;
+		return true;
+	}
+	if (!obj)
+		return false;
+	return CursorNext(idx);
+}
+
+// map and filter over vectors build a vector, sized up front
+// from the shortest input
+inline void CodeInterpreter::StartVecResult(size_t start,size_t count,size_t resIdx){
+	assert(count);
+	size_t size = -1ULL;
+	for (size_t i=0;i<count;++i){
+		SlangHeader* obj = argStack.data[start+i];
+		if (GetType(obj)!=SlangType::Vector)
+			return;
+		size = std::min(size,((SlangVec*)obj)->GetLength());
+	}
+	
+	SlangVec* vec = alloc.AllocateVec(size);
+	if (vec->storage)
+		vec->storage->size = 0;
+	argStack.data[resIdx] = (SlangHeader*)vec;
+}
+
+// only grows if the function grew its input while it was walked
+inline void CodeInterpreter::AppendToVec(size_t vecIdx,size_t valIdx){
+	SlangVec* vec = (SlangVec*)argStack.data[vecIdx];
+	if (!GetStorageFreeSpace(vec->storage)){
+		size_t cap = GetStorageCapacity(vec->storage);
+		SlangStorage* newStorage = alloc.AllocateStorage(3*cap/2+2,sizeof(SlangHeader*));
+		vec = (SlangVec*)argStack.data[vecIdx];
+		newStorage->size = GetStorageSize(vec->storage);
+		if (vec->storage)
+			memcpy(newStorage->objs,vec->storage->objs,newStorage->size*sizeof(SlangHeader*));
+		vec->storage = newStorage;
+		WriteBarrier(vec,(SlangHeader*)newStorage);
+	}
+	
+	SlangHeader* val = argStack.data[valIdx];
+	vec->storage->objs[vec->storage->size++] = val;
+	WriteBarrier(vec,val);
+}
+
+// reads range's args as the first int, the step between ints and how
+// many there are, a negative step walks the same ints as a positive
+// one but backwards
+inline bool GetRangeArgs(CodeInterpreter* c,int64_t* pos,int64_t* step,int64_t* count){
 	size_t argCount = c->GetArgCount();
 	int64_t start = 0;
 	int64_t end = 0;
-	int64_t step = 1;
+	int64_t stepArg = 1;
 	if (argCount==1){
 		SlangHeader* endObj = c->GetArg(0);
 		TYPE_CHECK_EXACT(endObj,SlangType::Int);
-		end = ((SlangObj*)endObj)->integer;
+		end = GetInt(endObj);
 	} else if (argCount==2){
 		SlangHeader* startObj = c->GetArg(0);
 		SlangHeader* endObj = c->GetArg(1);
 		TYPE_CHECK_EXACT(startObj,SlangType::Int);
 		TYPE_CHECK_EXACT(endObj,SlangType::Int);
-		start = ((SlangObj*)startObj)->integer;
-		end = ((SlangObj*)endObj)->integer;
+		start = GetInt(startObj);
+		end = GetInt(endObj);
 	} else {
 		SlangHeader* startObj = c->GetArg(0);
 		SlangHeader* endObj = c->GetArg(1);
@@ -8470,57 +11021,68 @@ bool CodeFuncRange(CodeInterpreter* c){
 		TYPE_CHECK_EXACT(startObj,SlangType::Int);
 		TYPE_CHECK_EXACT(endObj,SlangType::Int);
 		TYPE_CHECK_EXACT(stepObj,SlangType::Int);
-		start = ((SlangObj*)startObj)->integer;
-		end = ((SlangObj*)endObj)->integer;
-		step = ((SlangObj*)stepObj)->integer;
-		if (step==0){
+		start = GetInt(startObj);
+		end = GetInt(endObj);
+		stepArg = GetInt(stepObj);
+		if (stepArg==0){
 			c->PushError("RangeError","Step size cannot be zero!");
 			return false;
 		}
 	}
 	
-	if (start==end){
-		c->Return(nullptr);
+	*pos = 0;
+	*step = 0;
+	*count = 0;
+	if (start==end)
 		return true;
+	
+	int64_t dist = (end>start) ? end-start : start-end;
+	int64_t dir = (end>start) ? 1 : -1;
+	int64_t absStep = (stepArg>0) ? stepArg : -stepArg;
+	*count = (dist+absStep-1)/absStep;
+	if (stepArg>0){
+		*pos = start;
+		*step = dir*absStep;
+	} else {
+		*pos = start+dir*(*count-1)*absStep;
+		*step = -dir*absStep;
 	}
+	return true;
+}
+
+bool CodeFuncRange(CodeInterpreter* c){
+	int64_t pos,step,count;
+	if (!GetRangeArgs(c,&pos,&step,&count))
+		return false;
 	
-	SlangList* listIt;
+	// built back to front so each pair only needs linking once
 	size_t headIndex = c->argStack.size;
 	c->PushArg(nullptr);
-	size_t itIndex = c->argStack.size;
-	c->PushArg(nullptr);
-	if (end-start>0){
-		if (step>0){
-			for (int64_t i=start;i<end;i+=step){
-				RANGE_PATTERN();
-			}
-		} else {
-			int64_t realStart = ((end-start)/step)*step+start;
-			if (realStart==end) realStart += step;
-			// do it backwards
-			for (int64_t i=realStart;i>=start;i+=step){
-				RANGE_PATTERN();
-			}
-		}
-	} else {
-		if (step>0){
-			for (int64_t i=start;i>end;i-=step){
-				RANGE_PATTERN();
-			}
-		} else {
-			int64_t realStart = ((end-start)/step)*step+start;
-			if (realStart==end) realStart -= step;
-			for (int64_t i=realStart;i<=start;i-=step){
-				RANGE_PATTERN();
-			}
-		}
+	for (int64_t i=count-1;i>=0;--i){
+		c->PushArg(c->alloc.MakeInt(pos+i*step));
+		SlangList* list = c->alloc.AllocateList();
+		list->left = c->PopArg();
+		list->right = c->argStack.data[headIndex];
+		c->argStack.data[headIndex] = (SlangHeader*)list;
 	}
 	
-	c->Return(c->argStack.data[headIndex]);
+	c->Return(c->PopArg());
 	return true;
 }
 
-#undef RANGE_PATTERN
+// ints are made as they're walked, see CodeWriter::CompileIterable
+bool CodeFuncLazyRange(CodeInterpreter* c){
+	int64_t pos,step,count;
+	if (!GetRangeArgs(c,&pos,&step,&count))
+		return false;
+	
+	SlangIter* range = c->alloc.AllocateIter(ITER_RANGE);
+	range->pos = pos;
+	range->step = step;
+	range->count = count;
+	c->Return((SlangHeader*)range);
+	return true;
+}
 
 bool CodeFuncPair(CodeInterpreter* c){
 	SlangList* l = c->alloc.AllocateList();
@@ -8556,13 +11118,14 @@ bool CodeFuncSetLeft(CodeInterpreter* c){
 		c->TypeError(GetType(obj),SlangType::List);
 		return false;
 	}
-	if (!c->arena->InCurrSet((uint8_t*)obj)){
+	if (!c->arena->InHeap((uint8_t*)obj)){
 		c->PushError("SetError","Cannot set left of const data!");
 		return false;
 	}
 	
 	SlangHeader* val = c->GetArg(1);
 	((SlangList*)obj)->left = val;
+	c->WriteBarrier(obj,val);
 	c->Return(nullptr);
 	return true;
 }
@@ -8573,13 +11136,14 @@ bool CodeFuncSetRight(CodeInterpreter* c){
 		c->TypeError(GetType(obj),SlangType::List);
 		return false;
 	}
-	if (!c->arena->InCurrSet((uint8_t*)obj)){
+	if (!c->arena->InHeap((uint8_t*)obj)){
 		c->PushError("SetError","Cannot set right of const data!");
 		return false;
 	}
 	
 	SlangHeader* val = c->GetArg(1);
 	((SlangList*)obj)->right = val;
+	c->WriteBarrier(obj,val);
 	c->Return(nullptr);
 	return true;
 }
@@ -8601,9 +11165,12 @@ bool CodeFuncList(CodeInterpreter* c){
 		curr = (SlangList*)c->argStack.data[currIndex];
 		curr->left = c->GetArg(i);
 		curr->right = (SlangHeader*)newL;
+		c->WriteBarrier(curr,c->GetArg(i));
+		c->WriteBarrier(curr,(SlangHeader*)newL);
 		c->argStack.data[currIndex] = ((SlangList*)c->argStack.data[currIndex])->right;
 	}
 	((SlangList*)c->argStack.data[currIndex])->left = c->GetArg(argCount-1);
+	c->WriteBarrier(c->argStack.data[currIndex],c->GetArg(argCount-1));
 	c->Return(c->argStack.data[headIndex]);
 	return true;
 }
@@ -8614,13 +11181,13 @@ bool CodeFuncListGet(CodeInterpreter* c){
 	
 	TYPE_CHECK_EXACT(indexObj,SlangType::Int);
 	if (!listObj){
-		c->ListIndexError(((SlangObj*)indexObj)->integer);
+		c->ListIndexError(GetInt(indexObj));
 		return false;
 	}
 	
 	TYPE_CHECK_EXACT(listObj,SlangType::List);
 	
-	int64_t v = ((SlangObj*)indexObj)->integer;
+	int64_t v = GetInt(indexObj);
 	if (v<0){
 		c->ListIndexError(v);
 		return false;
@@ -8632,7 +11199,7 @@ bool CodeFuncListGet(CodeInterpreter* c){
 		list = (SlangList*)list->right;
 		
 		if (GetType((SlangHeader*)list)!=SlangType::List){
-			c->ListIndexError(((SlangObj*)indexObj)->integer);
+			c->ListIndexError(GetInt(indexObj));
 			return false;
 		}
 	}
@@ -8647,13 +11214,13 @@ bool CodeFuncListSet(CodeInterpreter* c){
 	
 	TYPE_CHECK_EXACT(indexObj,SlangType::Int);
 	if (!listObj){
-		c->ListIndexError(((SlangObj*)indexObj)->integer);
+		c->ListIndexError(GetInt(indexObj));
 		return false;
 	}
 	
 	TYPE_CHECK_EXACT(listObj,SlangType::List);
 	
-	int64_t v = ((SlangObj*)indexObj)->integer;
+	int64_t v = GetInt(indexObj);
 	if (v<0){
 		c->ListIndexError(v);
 		return false;
@@ -8665,16 +11232,17 @@ bool CodeFuncListSet(CodeInterpreter* c){
 		list = (SlangList*)list->right;
 		
 		if (GetType((SlangHeader*)list)!=SlangType::List){
-			c->ListIndexError(((SlangObj*)indexObj)->integer);
+			c->ListIndexError(GetInt(indexObj));
 			return false;
 		}
 	}
 	
-	if (!c->arena->InCurrSet((uint8_t*)list)){
+	if (!c->arena->InHeap((uint8_t*)list)){
 		c->PushError("SetError","Cannot set left of const data!");
 		return false;
 	}
 	list->left = item;
+	c->WriteBarrier(list,item);
 	c->Return(nullptr);
 	return true;
 }
@@ -8698,8 +11266,8 @@ bool CodeFuncListConcat(CodeInterpreter* c){
 		SlangHeader* arg = c->GetArg(i);
 		if (!arg)
 			continue;
-		if (arg->type!=SlangType::List){
-			c->TypeError(arg->type,SlangType::List);
+		if (GetType(arg)!=SlangType::List){
+			c->TypeError(GetType(arg),SlangType::List);
 			return false;
 		}
 		if (list){
@@ -8708,6 +11276,7 @@ bool CodeFuncListConcat(CodeInterpreter* c){
 			list = (SlangList*)c->PopArg();
 			
 			list->right = (SlangHeader*)copy;
+			c->WriteBarrier(list,(SlangHeader*)copy);
 		} else {
 			list = c->CopyList((SlangList*)arg);
 			c->PushArg((SlangHeader*)list);
@@ -8724,6 +11293,7 @@ bool CodeFuncListConcat(CodeInterpreter* c){
 		c->Return(last);
 	} else {
 		list->right = last;
+		c->WriteBarrier(list,last);
 		c->Return(c->PopArg());
 	}
 	return true;
@@ -8799,7 +11369,7 @@ bool CodeFuncVecAlloc(CodeInterpreter* c){
 		c->TypeError(GetType(sizeObj),SlangType::Int);
 		return false;
 	}
-	ssize_t vecSize = ((SlangObj*)sizeObj)->integer;
+	ssize_t vecSize = GetInt(sizeObj);
 	if (vecSize<0){
 		std::stringstream ss{};
 		ss << "Cannot allocate vector with size " << vecSize;
@@ -8807,6 +11377,10 @@ bool CodeFuncVecAlloc(CodeInterpreter* c){
 		return false;
 	}
 	SlangVec* vec = c->alloc.AllocateVec(vecSize);
+	if (!vec){
+		c->MemoryError();
+		return false;
+	}
 	SlangHeader* fill = nullptr;
 	if (argCount==2){
 		fill = c->GetArg(1);
@@ -8837,7 +11411,7 @@ bool CodeFuncVecGet(CodeInterpreter* c){
 		return false;
 	}
 	
-	int64_t index = ((SlangObj*)indexObj)->integer;
+	int64_t index = GetInt(indexObj);
 	if (!vec->storage){
 		c->IndexError(index,0);
 		return false;
@@ -8870,7 +11444,7 @@ bool CodeFuncVecSet(CodeInterpreter* c){
 		return false;
 	}
 	
-	int64_t index = ((SlangObj*)indexObj)->integer;
+	int64_t index = GetInt(indexObj);
 	if (!vec->storage){
 		c->IndexError(index,0);
 		return false;
@@ -8881,7 +11455,7 @@ bool CodeFuncVecSet(CodeInterpreter* c){
 		return false;
 	}
 	
-	if (!c->arena->InCurrSet((uint8_t*)vec)){
+	if (!c->arena->InHeap((uint8_t*)vec)){
 		c->PushError("SetError","Cannot vec-set! const vector!");
 		return false;
 	}
@@ -8893,6 +11467,7 @@ bool CodeFuncVecSet(CodeInterpreter* c){
 	SlangHeader* setObj = c->GetArg(2);
 	
 	vec->storage->objs[index] = setObj;
+	c->WriteBarrier(vec,setObj);
 	
 	c->Return(nullptr);
 	return true;
@@ -8906,13 +11481,14 @@ bool CodeFuncVecApp(CodeInterpreter* c){
 	}
 	
 	SlangVec* vec = (SlangVec*)vecObj;
-	if (!c->arena->InCurrSet((uint8_t*)vec)){
+	if (!c->arena->InHeap((uint8_t*)vec)){
 		c->PushError("SetError","Cannot vec-app! const vector!");
 		return false;
 	}
 	
 	if (vec->storage&&vec->storage->size<vec->storage->capacity){
 		vec->storage->objs[vec->storage->size++] = c->GetArg(1);
+		c->WriteBarrier(vec,c->GetArg(1));
 		c->Return(nullptr);
 		return true;
 	}
@@ -8924,6 +11500,10 @@ bool CodeFuncVecApp(CodeInterpreter* c){
 	} else {
 		size_t oldSize = vec->storage->size;
 		newStorage = c->alloc.AllocateStorage(3*vec->storage->capacity/2,sizeof(SlangHeader*));
+		if (!newStorage){
+			c->MemoryError();
+			return false;
+		}
 		newStorage->size = oldSize;
 	}
 	
@@ -8931,6 +11511,8 @@ bool CodeFuncVecApp(CodeInterpreter* c){
 	memcpy(newStorage->objs,vec->storage->objs,vec->storage->size*sizeof(SlangHeader*));
 	vec->storage = newStorage;
 	vec->storage->objs[vec->storage->size++] = c->GetArg(1);
+	c->WriteBarrier(vec,(SlangHeader*)newStorage);
+	c->WriteBarrier(vec,c->GetArg(1));
 	c->Return(nullptr);
 	return true;
 }
@@ -8943,7 +11525,7 @@ bool CodeFuncVecPop(CodeInterpreter* c){
 	}
 	
 	SlangVec* vec = (SlangVec*)vecObj;
-	if (!c->arena->InCurrSet((uint8_t*)vec)){
+	if (!c->arena->InHeap((uint8_t*)vec)){
 		c->PushError("SetError","Cannot vec-pop! const vector!");
 		return false;
 	}
@@ -9069,6 +11651,7 @@ bool CodeFuncDictKeys(CodeInterpreter* c){
 		newList->left = elem->key;
 		if (c->argStack.data[itIndex]){
 			((SlangList*)c->argStack.data[itIndex])->right = (SlangHeader*)newList;
+			c->WriteBarrier(c->argStack.data[itIndex],(SlangHeader*)newList);
 			c->argStack.data[itIndex] = (SlangHeader*)newList;
 		} else {
 			c->argStack.data[headIndex] = (SlangHeader*)newList;
@@ -9107,6 +11690,7 @@ bool CodeFuncDictValues(CodeInterpreter* c){
 		newList->left = elem->val;
 		if (c->argStack.data[itIndex]){
 			((SlangList*)c->argStack.data[itIndex])->right = (SlangHeader*)newList;
+			c->WriteBarrier(c->argStack.data[itIndex],(SlangHeader*)newList);
 			c->argStack.data[itIndex] = (SlangHeader*)newList;
 		} else {
 			c->argStack.data[headIndex] = (SlangHeader*)newList;
@@ -9126,7 +11710,7 @@ bool CodeFuncStrGet(CodeInterpreter* c){
 	TYPE_CHECK_EXACT(indexObj,SlangType::Int);
 	
 	SlangStr* str = (SlangStr*)strObj;
-	int64_t index = ((SlangObj*)indexObj)->integer;
+	int64_t index = GetInt(indexObj);
 	
 	if (!str->storage){
 		c->IndexError(index,0);
@@ -9160,7 +11744,7 @@ bool CodeFuncStrSet(CodeInterpreter* c){
 	TYPE_CHECK_EXACT(setStrObj,SlangType::String);
 	
 	SlangStr* str = (SlangStr*)strObj;
-	int64_t index = ((SlangObj*)indexObj)->integer;
+	int64_t index = GetInt(indexObj);
 	
 	if (!str->storage){
 		c->IndexError(index,0);
@@ -9299,6 +11883,7 @@ bool CodeFuncStrSplit(CodeInterpreter* c){
 				} else {
 					listIt = (SlangList*)c->argStack.data[itIndex];
 					listIt->right = (SlangHeader*)newList;
+					c->WriteBarrier((SlangHeader*)listIt,(SlangHeader*)newList);
 					c->argStack.data[itIndex] = (SlangHeader*)newList;
 				}
 				
@@ -9324,6 +11909,7 @@ bool CodeFuncStrSplit(CodeInterpreter* c){
 	} else {
 		listIt = (SlangList*)c->argStack.data[itIndex];
 		listIt->right = (SlangHeader*)newList;
+		c->WriteBarrier((SlangHeader*)listIt,(SlangHeader*)newList);
 	}
 	
 	listHead = (SlangList*)c->argStack.data[headIndex];
@@ -9355,7 +11941,7 @@ bool CodeFuncStrJoin(CodeInterpreter* c){
 	
 	size_t totalSize = 0;
 	while (joinList){
-		if (joinList->header.type!=SlangType::List){
+		if (GetType((SlangHeader*)joinList)!=SlangType::List){
 			c->DotError();
 			return false;
 		}
@@ -9479,7 +12065,7 @@ bool CodeFuncStreamRead(CodeInterpreter* c){
 		SlangHeader* intObj = c->GetArg(1);
 		TYPE_CHECK_EXACT(intObj,SlangType::Int);
 		
-		ssize_t cval = ((SlangObj*)intObj)->integer;
+		ssize_t cval = GetInt(intObj);
 		count = (cval < 0) ? 0 : cval;
 	}
 	
@@ -9534,7 +12120,7 @@ bool CodeFuncStreamWriteByte(CodeInterpreter* c){
 	SlangHeader* wObj = c->GetArg(1);
 	TYPE_CHECK_EXACT(wObj,SlangType::Int);
 	
-	uint8_t byte = ((SlangObj*)wObj)->integer&0xFF;
+	uint8_t byte = GetInt(wObj)&0xFF;
 	
 	SlangStream* stream = (SlangStream*)streamObj;
 	if (streamObj->isFile){
@@ -9560,6 +12146,7 @@ bool CodeFuncStreamWriteByte(CodeInterpreter* c){
 			newStorage->size = streamstr->storage->size;
 			memcpy(newStorage->data,streamstr->storage->data,sizeof(uint8_t)*streamstr->storage->size);
 			streamstr->storage = newStorage;
+			c->WriteBarrier((SlangHeader*)streamstr,(SlangHeader*)newStorage);
 		}
 		
 		if (stream->pos==streamstr->storage->size)
@@ -9587,7 +12174,7 @@ bool CodeFuncStreamReadByte(CodeInterpreter* c){
 			c->Return(c->codeWriter.constEOFObj);
 			return true;
 		}
-		c->Return((SlangHeader*)c->alloc.MakeInt(ch&0xFF));
+		c->Return(c->alloc.MakeInt(ch&0xFF));
 	} else {
 		size_t bytesLeft = GetStorageSize(stream->str->storage)-stream->pos;
 		if (bytesLeft==0){
@@ -9596,8 +12183,149 @@ bool CodeFuncStreamReadByte(CodeInterpreter* c){
 		}
 		
 		uint8_t byte = stream->str->storage->data[stream->pos++];
-		c->Return((SlangHeader*)c->alloc.MakeInt(byte));
+		c->Return(c->alloc.MakeInt(byte));
+	}
+	return true;
+}
+
+inline bool GetByteVecArg(CodeInterpreter* c,size_t i,SlangPacked** bytes){
+	SlangHeader* obj = c->GetArg(i);
+	TYPE_CHECK_EXACT(obj,SlangType::Packed);
+	if (obj->packKind!=PACK_U8){
+		c->PushError("TypeError","Expected a u8 packed vector!");
+		return false;
+	}
+	*bytes = (SlangPacked*)obj;
+	return true;
+}
+
+bool CodeFuncStreamWriteBytes(CodeInterpreter* c){
+	SlangHeader* streamObj = c->GetArg(0);
+	TYPE_CHECK_EXACT(streamObj,SlangType::OutputStream);
+	
+	SlangPacked* bytes;
+	if (!GetByteVecArg(c,1,&bytes))
+		return false;
+	
+	size_t count = bytes->GetLength();
+	SlangStream* stream = (SlangStream*)streamObj;
+	if (streamObj->isFile){
+		if (!stream->file){
+			c->FileError("Cannot write to a closed file!");
+			return false;
+		}
+		if (count&&fwrite(bytes->storage->data,1,count,stream->file)!=count){
+			c->FileError("Could not write to file!");
+			return false;
+		}
+		c->Return((SlangHeader*)stream);
+		return true;
+	}
+	
+	SlangStr* streamstr = stream->str;
+	if (GetStorageCapacity(streamstr->storage)<stream->pos+count){
+		size_t newCap = stream->pos+count;
+		newCap = newCap*3/2+8;
+		SlangStorage* newStorage = c->alloc.AllocateStorage(newCap,sizeof(uint8_t));
+		
+		// fix pointers
+		stream = (SlangStream*)c->GetArg(0);
+		bytes = (SlangPacked*)c->GetArg(1);
+		streamstr = stream->str;
+		
+		newStorage->size = GetStorageSize(streamstr->storage);
+		if (newStorage->size)
+			memcpy(newStorage->data,streamstr->storage->data,newStorage->size);
+		streamstr->storage = newStorage;
+		c->WriteBarrier((SlangHeader*)streamstr,(SlangHeader*)newStorage);
+	}
+	
+	if (count)
+		memcpy(streamstr->storage->data+stream->pos,bytes->storage->data,count);
+	stream->pos += count;
+	if (stream->pos>streamstr->storage->size)
+		streamstr->storage->size = stream->pos;
+	
+	c->Return((SlangHeader*)stream);
+	return true;
+}
+
+// given a size reads into a new u8 vector, given a u8 vector fills it
+// up to its length, which is cut down to what was read
+bool CodeFuncStreamReadBytes(CodeInterpreter* c){
+	SlangHeader* streamObj = c->GetArg(0);
+	TYPE_CHECK_EXACT(streamObj,SlangType::InputStream);
+	SlangStream* stream = (SlangStream*)streamObj;
+	if (streamObj->isFile&&!stream->file){
+		c->FileError("Cannot read from a closed file!");
+		return false;
+	}
+	
+	SlangHeader* arg = c->GetArg(1);
+	SlangPacked* bytes;
+	size_t count;
+	if (GetType(arg)==SlangType::Int){
+		if (GetInt(arg)<0){
+			c->PushError("ValueError","Cannot read a negative number of bytes!");
+			return false;
+		}
+		count = GetInt(arg);
+		// allocate what can actually be read, a file may be much
+		// shorter than asked for so its result grows in chunks
+		size_t cap = count;
+		if (!stream->header.isFile)
+			cap = std::min(count,GetStorageSize(stream->str->storage)-stream->pos);
+		else if (cap>READ_BYTES_CHUNK)
+			cap = READ_BYTES_CHUNK;
+		bytes = c->alloc.AllocatePacked(PACK_U8,cap);
+		if (!bytes){
+			c->MemoryError();
+			return false;
+		}
+		stream = (SlangStream*)c->GetArg(0);
+	} else {
+		if (!GetByteVecArg(c,1,&bytes))
+			return false;
+		if (!c->arena->InHeap((uint8_t*)bytes)){
+			c->PushError("SetError","Cannot read-bytes! into const vector!");
+			return false;
+		}
+		count = bytes->GetLength();
+	}
+	
+	size_t read;
+	if (stream->header.isFile){
+		size_t cap = bytes->GetLength();
+		read = cap ? fread(bytes->storage->data,1,cap,stream->file) : 0;
+		// chunks are large storage, so growing never collects
+		while (read==cap&&cap<count){
+			cap = std::min(count,cap*2);
+			SlangStorage* newStorage = c->alloc.AllocateStorage(cap,sizeof(uint8_t));
+			if (!newStorage){
+				c->MemoryError();
+				return false;
+			}
+			memcpy(newStorage->data,bytes->storage->data,read);
+			bytes->storage = newStorage;
+			c->WriteBarrier(bytes,(SlangHeader*)newStorage);
+			read += fread(newStorage->data+read,1,cap-read,stream->file);
+		}
+	} else {
+		size_t bytesLeft = GetStorageSize(stream->str->storage)-stream->pos;
+		read = std::min(count,bytesLeft);
+		if (read)
+			memcpy(bytes->storage->data,stream->str->storage->data+stream->pos,read);
+		stream->pos += read;
+	}
+	
+	if (count&&!read){
+		c->Return(c->codeWriter.constEOFObj);
+		return true;
 	}
+	
+	if (bytes->storage)
+		bytes->storage->size = read;
+	c->Return((SlangHeader*)bytes);
 	return true;
 }
 
@@ -9610,7 +12338,7 @@ bool CodeFuncStreamSeekBegin(CodeInterpreter* c){
 	if (c->GetArgCount()==2){
 		SlangHeader* intObj = c->GetArg(1);
 		TYPE_CHECK_EXACT(intObj,SlangType::Int);
-		offset = ((SlangObj*)intObj)->integer;
+		offset = GetInt(intObj);
 	}
 	
 	if (stream->header.isFile){
@@ -9638,7 +12366,7 @@ bool CodeFuncStreamSeekEnd(CodeInterpreter* c){
 	if (c->GetArgCount()==2){
 		SlangHeader* intObj = c->GetArg(1);
 		TYPE_CHECK_EXACT(intObj,SlangType::Int);
-		offset = ((SlangObj*)intObj)->integer;
+		offset = GetInt(intObj);
 	}
 	
 	if (stream->header.isFile){
@@ -9669,7 +12397,7 @@ bool CodeFuncStreamSeekOffset(CodeInterpreter* c){
 	if (c->GetArgCount()==2){
 		SlangHeader* intObj = c->GetArg(1);
 		TYPE_CHECK_EXACT(intObj,SlangType::Int);
-		offset = ((SlangObj*)intObj)->integer;
+		offset = GetInt(intObj);
 	}
 	
 	if (stream->header.isFile){
@@ -9707,7 +12435,7 @@ bool CodeFuncStreamTell(CodeInterpreter* c){
 	} else {
 		t = stream->pos;
 	}
-	c->Return((SlangHeader*)c->alloc.MakeInt(t));
+	c->Return(c->alloc.MakeInt(t));
 	return true;
 }
 
@@ -9849,14 +12577,14 @@ bool CodeFuncIsMain(CodeInterpreter* c){
 bool CodeFuncIntToReal(CodeInterpreter* c){
 	SlangHeader* intObj = c->GetArg(0);
 	TYPE_CHECK_EXACT(intObj,SlangType::Int);
-	c->Return((SlangHeader*)c->alloc.MakeReal((double)((SlangObj*)intObj)->integer));
+	c->Return(c->alloc.MakeReal((double)GetInt(intObj)));
 	return true;
 }
 
 bool CodeFuncRealToInt(CodeInterpreter* c){
 	SlangHeader* realObj = c->GetArg(0);
 	TYPE_CHECK_EXACT(realObj,SlangType::Real);
-	c->Return((SlangHeader*)c->alloc.MakeInt((int64_t)((SlangObj*)realObj)->real));
+	c->Return(c->alloc.MakeInt((int64_t)GetReal(realObj)));
 	return true;
 }
 
@@ -9869,22 +12597,22 @@ bool CodeFuncCharToByte(CodeInterpreter* c){
 		return false;
 	}
 	uint8_t val = str->storage->data[0];
-	c->Return((SlangHeader*)c->alloc.MakeInt(val));
+	c->Return(c->alloc.MakeInt(val));
 	return true;
 }
 
 bool CodeFuncByteToChar(CodeInterpreter* c){
 	SlangHeader* intObj = c->GetArg(0);
 	TYPE_CHECK_EXACT(intObj,SlangType::Int);
-	SlangObj* intVal = (SlangObj*)intObj;
-	if (intVal->integer>=256||intVal->integer<0){
+	int64_t intVal = GetInt(intObj);
+	if (intVal>=256||intVal<0){
 		std::stringstream ss{};
 		ss << "Expected integer between 0 and 255, not ";
-		ss << intVal->integer;
+		ss << intVal;
 		c->PushError("TypeError",ss.str());
 		return false;
 	}
-	uint8_t val = intVal->integer;
+	uint8_t val = intVal;
 	SlangStr* s = c->alloc.AllocateStr(1);
 	s->storage->data[0] = val;
 	c->Return((SlangHeader*)s);
@@ -9895,13 +12623,12 @@ bool CodeFuncNumToStr(CodeInterpreter* c){
 	static char printArr[32];
 	SlangHeader* numObj = c->GetArg(0);
 	TYPE_CHECK_NUMERIC(numObj);
-	SlangObj* num = (SlangObj*)numObj;
 	size_t written;
-	if (numObj->type==SlangType::Int){
-		int64_t val = num->integer;
+	if (GetType(numObj)==SlangType::Int){
+		int64_t val = GetInt(numObj);
 		written = snprintf(printArr,sizeof(printArr),"%lld",val);
 	} else {
-		double val = num->real;
+		double val = GetReal(numObj);
 		if (val==floor(val)&&abs(val)<1e16)
 			written = snprintf(printArr,sizeof(printArr),"%.16g.0",val);
 		else
@@ -9934,7 +12661,7 @@ bool CodeFuncStrToNum(CodeInterpreter* c){
 			return false;
 		}
 		int64_t n = ch-'0';
-		c->Return((SlangHeader*)c->alloc.MakeInt(n));
+		c->Return(c->alloc.MakeInt(n));
 		return true;
 	}
 	
@@ -9981,18 +12708,21 @@ bool CodeFuncStrToList(CodeInterpreter* c){
 	firstChar->storage->data[0] = firstC;
 	list = (SlangList*)c->PeekArg();
 	list->left = (SlangHeader*)firstChar;
+	c->WriteBarrier((SlangHeader*)list,(SlangHeader*)firstChar);
 	
 	SlangList* newList;
 	for (size_t i=1;i<size;++i){
 		newList = c->alloc.AllocateList();
 		list = (SlangList*)c->PeekArg();
 		list->right = (SlangHeader*)newList;
+		c->WriteBarrier((SlangHeader*)list,(SlangHeader*)newList);
 		c->argStack.data[itIndex] = (SlangHeader*)newList;
 		SlangStr* charStr = c->alloc.AllocateStr(1);
 		str = (SlangStr*)c->GetArg(0);
 		charStr->storage->data[0] = str->storage->data[i];
 		newList = (SlangList*)c->PeekArg();
 		newList->left = (SlangHeader*)charStr;
+		c->WriteBarrier((SlangHeader*)newList,(SlangHeader*)charStr);
 	}
 	
 	c->Return(c->argStack.data[headIndex]);
@@ -10059,6 +12789,8 @@ bool CFHandleImport(CodeInterpreter* c,SlangList* nameList){
 	ModuleData& md = c->modules.PlaceBack();
 	md.exportEnv = nullptr;
 	md.globalEnv = nullptr;
+	md.exportIndex.Init(nullptr);
+	md.globalIndex.Init(nullptr);
 	size_t newFunc;
 	if (!c->LoadModule(mname,code,newFunc))
 		return false;
@@ -10066,8 +12798,10 @@ bool CFHandleImport(CodeInterpreter* c,SlangList* nameList){
 	md.exportEnv = c->AllocateEnvs(4);
 	SlangEnv* newEnv = c->AllocateEnvs(4);
 	md.globalEnv = newEnv;
+	md.exportIndex.Init(md.exportEnv);
+	md.globalIndex.Init(newEnv);
 	c->stack.PushBack({c->argStack.size});
-	c->Call(newFunc,newEnv,false);
+	c->Call(newFunc,newEnv);
 	return true;
 }
 
@@ -10089,12 +12823,12 @@ bool CodeFuncExport(CodeInterpreter* c){
 		return false;
 	}
 	
-	SlangHeader* d;
-	if (exportEnv->GetSymbol(sym,&d)){
+	EnvIndex& exportIndex = c->modules.data[moduleName].exportIndex;
+	if (exportIndex.Lookup(sym)!=-1ULL){
 		c->ExportError(sym);
 		return false;
 	}
-	c->DefEnvSymbol(exportEnv,sym,val);
+	c->DefIndexedSymbol(exportIndex,sym,val);
 	c->Return(nullptr);
 	return true;
 }
@@ -10125,6 +12859,7 @@ const CodeFunc CodeBuiltinFuncs[] = {
 	CodeFuncFilter,
 	CodeFuncFold,
 	CodeFuncRange,
+	CodeFuncLazyRange,
 	CodeFuncAnd,
 	CodeFuncOr,
 	CodeFuncInvalid, // try
@@ -10167,6 +12902,8 @@ const CodeFunc CodeBuiltinFuncs[] = {
 	CodeFuncStreamRead,
 	CodeFuncStreamWriteByte,
 	CodeFuncStreamReadByte,
+	CodeFuncStreamWriteBytes,
+	CodeFuncStreamReadBytes,
 	CodeFuncStreamSeekBegin,
 	CodeFuncStreamSeekEnd,
 	CodeFuncStreamSeekOffset,
@@ -10249,20 +12986,6 @@ inline bool CFHandleArgs(CodeInterpreter* c,SlangEnv* lamEnv,const CodeBlock& cb
 		SlangList* vaList = c->MakeVariadicList(vaStart,vaEnd);
 		c->argStack.size = vaStart;
 		c->PushArg((SlangHeader*)vaList);
-		
-		if (cb.isClosure){
-			argCount = c->argStack.size-base;
-			lamEnv = c->lamEnv;
-			
-			SlangEnv* envIt = lamEnv;
-			for (size_t i=0;i<argCount;++i){
-				auto& mapping = envIt->mappings[i%SLANG_ENV_BLOCK_SIZE];
-				mapping.obj = c->argStack.data[base+i];
-				
-				if (i%SLANG_ENV_BLOCK_SIZE==SLANG_ENV_BLOCK_SIZE-1)
-					envIt = envIt->next;
-			}
-		}
 		return true;
 	} else {
 		size_t base = c->stack.Back().base;
@@ -10271,27 +12994,14 @@ inline bool CFHandleArgs(CodeInterpreter* c,SlangEnv* lamEnv,const CodeBlock& cb
 			c->ArityError(argCount,cb.params.size,cb.params.size);
 			return false;
 		}
-		if (cb.isClosure){
-			SlangEnv* envIt = lamEnv;
-			for (size_t i=0;i<argCount;++i){
-				auto& mapping = envIt->mappings[i%SLANG_ENV_BLOCK_SIZE];
-				mapping.obj = c->argStack.data[base+i];
-				
-				if (i%SLANG_ENV_BLOCK_SIZE==SLANG_ENV_BLOCK_SIZE-1)
-					envIt = envIt->next;
-			}
-		}
 	}
 	return true;
 }
 
 inline bool MapInnerLoop(CodeInterpreter* c,size_t listsBase,size_t argCount){
 	for (size_t i=0;i<argCount;++i){
-		if (GetType(c->argStack.data[listsBase+i])!=SlangType::List){
+		if (!c->IterNext(listsBase+i))
 			return false;
-		}
-		c->PushArg(((SlangList*)c->argStack.data[listsBase+i])->left);
-		c->argStack.data[listsBase+i] = ((SlangList*)c->argStack.data[listsBase+i])->right;
 	}
 	
 	return true;
@@ -10308,26 +13018,33 @@ bool CodeFuncMap(CodeInterpreter* c){
 	
 	for (size_t i=0;i<argCount;++i){
 		SlangHeader* arg = c->GetArg(i+1);
-		if (!IsList(arg)){
-			c->TypeError(arg->type,SlangType::List);
+		if (!IsIterable(arg)){
+			c->TypeError(GetType(arg),SlangType::List);
 			return false;
 		}
 	}
 	
 	size_t resIndex = c->argStack.size;
 	size_t currIndex = c->argStack.size+1;
-	SlangList* resL = c->alloc.AllocateList();
-	c->PushArg((SlangHeader*)resL);
-	c->PushArg((SlangHeader*)resL);
-	funcArg = c->GetArg(0);
+	c->PushArg(nullptr);
+	c->PushArg(nullptr);
+	c->StartVecResult(listsBase,argCount,resIndex);
+	bool toVec = GetType(c->argStack.data[resIndex])==SlangType::Vector;
+	if (!toVec){
+		SlangList* resL = c->alloc.AllocateList();
+		c->argStack.data[resIndex] = (SlangHeader*)resL;
+		c->argStack.data[currIndex] = (SlangHeader*)resL;
+	}
 	
 	c->PushFrame();
 	size_t argFrameStart = c->argStack.size;
 	if (!MapInnerLoop(c,listsBase,argCount)){
-		c->Return(nullptr);
+		c->PopFrame();
+		c->Return(toVec ? c->argStack.data[resIndex] : nullptr);
 		return true;
 	}
-	if (funcArg->type==SlangType::Symbol&&
+	funcArg = c->argStack.data[listsBase-1];
+	if (GetType(funcArg)==SlangType::Symbol&&
 		((SlangObj*)funcArg)->symbol<GLOBAL_SYMBOL_COUNT){
 		SymbolName sym = ((SlangObj*)funcArg)->symbol;
 		assert(GoodArity(sym,argCount));
@@ -10337,18 +13054,27 @@ bool CodeFuncMap(CodeInterpreter* c){
 			if (!f(c))
 				return false;
 			
-			((SlangList*)c->argStack.data[currIndex])->left = c->PopArg();
+			if (toVec){
+				c->AppendToVec(resIndex,c->argStack.size-1);
+				c->PopArg();
+			} else {
+				((SlangList*)c->argStack.data[currIndex])->left = c->PopArg();
+				c->WriteBarrier(c->argStack.data[currIndex],((SlangList*)c->argStack.data[currIndex])->left);
+			}
 			
 			c->argStack.size = argFrameStart;
 			c->PushFrame();
 			if (!MapInnerLoop(c,listsBase,argCount))
 				break;
+			if (toVec)
+				continue;
 			SlangList* newList = c->alloc.AllocateList();
 			((SlangList*)c->argStack.data[currIndex])->right = (SlangHeader*)newList;
+			c->WriteBarrier(c->argStack.data[currIndex],(SlangHeader*)newList);
 			c->argStack.data[currIndex] = (SlangHeader*)newList;
 		}
 	} else {
-		c->TypeError(funcArg->type,SlangType::Lambda);
+		c->TypeError(GetType(funcArg),SlangType::Lambda);
 		return false;
 	}
 	c->PopFrame();
@@ -10368,21 +13094,21 @@ bool CodeFuncForeach(CodeInterpreter* c){
 	
 	for (size_t i=0;i<argCount;++i){
 		SlangHeader* arg = c->GetArg(i+1);
-		if (!IsList(arg)){
-			c->TypeError(arg->type,SlangType::List);
+		if (!IsIterable(arg)){
+			c->TypeError(GetType(arg),SlangType::List);
 			return false;
 		}
 	}
 	
-	funcArg = c->GetArg(0);
-	
 	c->PushFrame();
 	size_t argFrameStart = c->argStack.size;
 	if (!MapInnerLoop(c,listsBase,argCount)){
+		c->PopFrame();
 		c->Return(nullptr);
 		return true;
 	}
-	if (funcArg->type==SlangType::Symbol&&
+	funcArg = c->argStack.data[listsBase-1];
+	if (GetType(funcArg)==SlangType::Symbol&&
 		((SlangObj*)funcArg)->symbol<GLOBAL_SYMBOL_COUNT){
 		SymbolName sym = ((SlangObj*)funcArg)->symbol;
 		assert(GoodArity(sym,argCount));
@@ -10398,7 +13124,7 @@ bool CodeFuncForeach(CodeInterpreter* c){
 				break;
 		}
 	} else {
-		c->TypeError(funcArg->type,SlangType::Lambda);
+		c->TypeError(GetType(funcArg),SlangType::Lambda);
 		return false;
 	}
 	c->PopFrame();
@@ -10417,27 +13143,33 @@ bool CodeFuncFilter(CodeInterpreter* c){
 		return false;
 	}
 	
-	if (!IsList(listArg)){
-		c->TypeError(listArg->type,SlangType::List);
+	if (!IsIterable(listArg)){
+		c->TypeError(GetType(listArg),SlangType::List);
 		return false;
 	}
 	
-	if (!listArg){
-		c->Return(nullptr);
-		return true;
-	}
-	
 	size_t resIndex = c->argStack.size;
 	size_t currIndex = c->argStack.size+1;
+	// the item being tested, the list slot has moved past it
+	size_t itemIndex = c->argStack.size+2;
 	
 	c->PushArg(nullptr);
 	c->PushArg(nullptr);
+	c->PushArg(nullptr);
+	c->StartVecResult(listPos,1,resIndex);
+	bool toVec = GetType(c->argStack.data[resIndex])==SlangType::Vector;
 	
 	c->PushFrame();
-	c->PushArg(((SlangList*)listArg)->left);
+	if (!c->IterNext(listPos)){
+		c->PopFrame();
+		c->Return(c->argStack.data[resIndex]);
+		return true;
+	}
+	c->argStack.data[itemIndex] = c->PeekArg();
 	
+	funcArg = c->argStack.data[listPos-1];
 	SlangHeader* predRes;
-	if (funcArg->type==SlangType::Symbol&&
+	if (GetType(funcArg)==SlangType::Symbol&&
 		((SlangObj*)funcArg)->symbol<GLOBAL_SYMBOL_COUNT){
 		SymbolName sym = ((SlangObj*)funcArg)->symbol;
 		assert(GoodArity(sym,1));
@@ -10448,38 +13180,38 @@ bool CodeFuncFilter(CodeInterpreter* c){
 				return false;
 			
 			predRes = c->PopArg();
-			if (ConvertToBool(predRes)){
+			if (ConvertToBool(predRes)&&toVec){
+				c->AppendToVec(resIndex,itemIndex);
+			} else if (ConvertToBool(predRes)){
 				SlangList* newList = c->alloc.AllocateList();
 				if (!c->argStack.data[resIndex]){
 					c->argStack.data[resIndex] = (SlangHeader*)newList;
 					c->argStack.data[currIndex] = (SlangHeader*)newList;
-				} else
+				} else {
 					((SlangList*)c->argStack.data[currIndex])->right = (SlangHeader*)newList;
+					c->WriteBarrier(c->argStack.data[currIndex],(SlangHeader*)newList);
+				}
 				
-				newList->left = ((SlangList*)c->argStack.data[listPos])->left;
+				newList->left = c->argStack.data[itemIndex];
 				c->argStack.data[currIndex] = (SlangHeader*)newList;
 			}
 			
 			c->PushFrame();
-			c->argStack.data[listPos] = ((SlangList*)c->argStack.data[listPos])->right;
-			
-			if (GetType(c->argStack.data[listPos])!=SlangType::List){
+			if (!c->IterNext(listPos)){
 				c->PopFrame();
 				c->Return(c->argStack.data[resIndex]);
 				return true;
 			}
-			
-			c->PushArg(((SlangList*)c->argStack.data[listPos])->left);
+			c->argStack.data[itemIndex] = c->PeekArg();
 		}
 	} else {
-		c->TypeError(funcArg->type,SlangType::Lambda);
+		c->TypeError(GetType(funcArg),SlangType::Lambda);
 		return false;
 	}
 }
 
 bool CodeFuncFold(CodeInterpreter* c){
 	SlangHeader* funcArg = c->GetArg(0);
-	SlangHeader* initArg = c->GetArg(1);
 	SlangHeader* listArg = c->GetArg(2);
 	size_t listPos = c->stack.Back().base+2;
 	
@@ -10488,22 +13220,24 @@ bool CodeFuncFold(CodeInterpreter* c){
 		return false;
 	}
 	
-	if (!IsList(listArg)){
-		c->TypeError(listArg->type,SlangType::List);
+	if (!IsIterable(listArg)){
+		c->TypeError(GetType(listArg),SlangType::List);
 		return false;
 	}
 	
-	if (!listArg){
+	c->PushFrame();
+	
+	c->PushArg(c->argStack.data[listPos-1]);
+	if (!c->IterNext(listPos)){
+		SlangHeader* initArg = c->PopArg();
+		c->PopFrame();
 		c->Return(initArg);
 		return true;
 	}
 	
-	c->PushFrame();
-	
-	c->PushArg(initArg);
-	c->PushArg(((SlangList*)listArg)->left);
+	funcArg = c->argStack.data[listPos-2];
 	SlangHeader* res;
-	if (funcArg->type==SlangType::Symbol&&
+	if (GetType(funcArg)==SlangType::Symbol&&
 		((SlangObj*)funcArg)->symbol<GLOBAL_SYMBOL_COUNT){
 		SymbolName sym = ((SlangObj*)funcArg)->symbol;
 		assert(GoodArity(sym,2));
@@ -10515,19 +13249,16 @@ bool CodeFuncFold(CodeInterpreter* c){
 			
 			c->PushFrame();
 			--c->stack.Back().base;
-			c->argStack.data[listPos] = ((SlangList*)c->argStack.data[listPos])->right;
 			
-			if (GetType(c->argStack.data[listPos])!=SlangType::List){
+			if (!c->IterNext(listPos)){
 				res = c->PopArg();
 				c->PopFrame();
 				c->Return(res);
 				return true;
 			}
-			
-			c->PushArg(((SlangList*)c->argStack.data[listPos])->left);
 		}
 	} else {
-		c->TypeError(funcArg->type,SlangType::Lambda);
+		c->TypeError(GetType(funcArg),SlangType::Lambda);
 		return false;
 	}
 }
@@ -10549,7 +13280,7 @@ bool CodeFuncApply(CodeInterpreter* c){
 	}
 	SlangHeader* vArg = c->GetArg(argCount+1);
 	if (!IsList(vArg)){
-		c->TypeError(vArg->type,SlangType::List);
+		c->TypeError(GetType(vArg),SlangType::List);
 		return false;
 	}
 	
@@ -10578,7 +13309,6 @@ bool CodeFuncApply(CodeInterpreter* c){
 	} else {
 		SlangLambda* lam = (SlangLambda*)func;
 		size_t funcIndex = lam->funcIndex;
-		bool isClosure = (func->flags & FLAG_CLOSURE);
 		c->lamEnv = lam->env;
 		[[unlikely]]
 		if (!CFHandleArgs(c,
@@ -10586,7 +13316,7 @@ bool CodeFuncApply(CodeInterpreter* c){
 							c->codeWriter.lambdaCodes[funcIndex]))
 			return false;
 			
-		c->Call(funcIndex,c->lamEnv,isClosure);
+		c->Call(funcIndex,c->lamEnv);
 		c->lamEnv = nullptr;
 	}
 	
@@ -10605,12 +13335,78 @@ bool CodeFuncApply(CodeInterpreter* c){
 		return; \
 	}
 
+#define LOOP_PUSH_NUMERIC(isReal,i,r) \
+	if (isReal) \
+		c->PushArg(c->alloc.MakeReal(r)); \
+	else \
+		c->PushArg(c->alloc.MakeInt(i));
+
+// nth register operand of a register form inst, dst is operand 0
+#define LOOP_REG(n) (*(uint16_t*)(c->pc+OPCODE_SIZE+2*(n)))
+
+#define LOOP_REG_OPERANDS2() \
+	v64 = c->RegisterBase(); \
+	val = c->argStack.data[v64+LOOP_REG(1)]; \
+	val2 = c->argStack.data[v64+LOOP_REG(2)];
+
+// two operand arith into the dst register, realInit matches
+// the first step of the general op
+#define LOOP_REG_ARITH2(op,realInit) \
+	LOOP_TYPE_CHECK_NUMERIC(val); \
+	LOOP_TYPE_CHECK_NUMERIC(val2); \
+	if (GetType(val)==SlangType::Int&&GetType(val2)==SlangType::Int){ \
+		c->SetTopRegister(v64+LOOP_REG(0),c->alloc.MakeInt(GetInt(val) op GetInt(val2))); \
+		NEXT_INST(); \
+	} \
+	if (GetType(val)==SlangType::Real) \
+		real = realInit GetReal(val); \
+	else \
+		real = (double)GetInt(val); \
+	if (GetType(val2)==SlangType::Real) \
+		real = real op GetReal(val2); \
+	else \
+		real = real op GetInt(val2); \
+	c->SetTopRegister(v64+LOOP_REG(0),c->alloc.MakeReal(real)); \
+	NEXT_INST();
+
+// two operands of one type turn the generic op into its
+// quickened form, the current inst still runs generically
+#define LOOP_QUICKEN(intOp,realOp) \
+	if (*(uint16_t*)(c->pc+OPCODE_SIZE)==2){ \
+		val = c->argStack.data[c->argStack.size-2]; \
+		val2 = c->argStack.data[c->argStack.size-1]; \
+		if (GetType(val)==SlangType::Int&&GetType(val2)==SlangType::Int) \
+			*(uint8_t*)c->pc = (intOp); \
+		else if (GetType(val)==SlangType::Real&&GetType(val2)==SlangType::Real) \
+			*(uint8_t*)c->pc = (realOp); \
+	}
+
+// loads the operands of a quickened op, a type miss puts the
+// generic op back and runs the inst again through it
+#define LOOP_QUICK_OPERANDS(type,generic) \
+	val = c->argStack.data[c->argStack.size-2]; \
+	val2 = c->argStack.data[c->argStack.size-1]; \
+	if (GetType(val)!=(type)||GetType(val2)!=(type)){ \
+		*(uint8_t*)c->pc = (generic); \
+		c->pc -= SlangOpSizes[op]; \
+		NEXT_INST(); \
+	}
+
+// charges pending profiler ticks to the running frame, polled before
+// calls and returns and after builtins so time spent in either is
+// charged to the frame it was spent in
+#define PROFILE_POLL() \
+	if (gProfileTicks.load(std::memory_order_relaxed)) [[unlikely]] \
+		c->TakeProfileSample();
+
 #define NEXT_INST() \
 	c->pc += SlangOpSizes[op]; \
+	PROFILE_OPS_STEP(); \
 	op = *c->pc; \
 	++stepCount; \
 	goto *blocks[op];
 
+
 #define LOOP_NAME GotoLoop
 
 #define LOOP_PREAMBLE() \
@@ -10624,9 +13420,9 @@ bool CodeFuncApply(CodeInterpreter* c){
 		&&SLANG_OP_ZERO_label, \
 		&&SLANG_OP_ONE_label, \
 		&&SLANG_OP_PUSH_LAMBDA_label, \
+		&&SLANG_OP_MAKE_CLOSURE_label, \
 		\
-		&&SLANG_OP_LOOKUP_label, \
-		&&SLANG_OP_SET_label, \
+		&&SLANG_OP_GET_CAPTURE_label, \
 		&&SLANG_OP_GET_LOCAL_label, \
 		&&SLANG_OP_SET_LOCAL_label, \
 		&&SLANG_OP_GET_GLOBAL_label, \
@@ -10634,10 +13430,12 @@ bool CodeFuncApply(CodeInterpreter* c){
 		&&SLANG_OP_DEF_GLOBAL_label, \
 		&&SLANG_OP_GET_STACK_label, \
 		&&SLANG_OP_SET_STACK_label, \
+		&&SLANG_OP_MAKE_BOX_label, \
+		&&SLANG_OP_UNBOX_label, \
+		&&SLANG_OP_SET_BOX_label, \
 		\
 		&&SLANG_OP_PUSH_FRAME_label, \
 		&&SLANG_OP_POP_ARG_label, \
-		&&SLANG_OP_INTERNAL_DEF_label, \
 		&&SLANG_OP_UNPACK_label, \
 		&&SLANG_OP_COPY_label, \
 		&&SLANG_OP_CALL_label, \
@@ -10684,8 +13482,41 @@ bool CodeFuncApply(CodeInterpreter* c){
 		&&SLANG_OP_VEC_SET_label, \
 		&&SLANG_OP_EXPORT_label, \
 		&&SLANG_OP_IMPORT_label, \
+		\
+		&&SLANG_OP_GET_LOCAL2_label, \
+		&&SLANG_OP_PUSH_FRAME_LOCAL_label, \
+		&&SLANG_OP_DEC_LOCAL_label, \
+		&&SLANG_OP_ADD_LOCALS_label, \
+		&&SLANG_OP_CJUMP_LOCAL_label, \
+		&&SLANG_OP_REG_STORE_label, \
+		&&SLANG_OP_REG_ADD_label, \
+		&&SLANG_OP_REG_SUB_label, \
+		&&SLANG_OP_REG_MUL_label, \
+		&&SLANG_OP_REG_DIV_label, \
+		&&SLANG_OP_REG_EQ_label, \
+		&&SLANG_OP_REG_PAIR_label, \
+		&&SLANG_OP_REG_NOT_label, \
+		&&SLANG_OP_REG_INC_label, \
+		&&SLANG_OP_REG_DEC_label, \
+		&&SLANG_OP_REG_NEG_label, \
+		&&SLANG_OP_REG_LEFT_label, \
+		&&SLANG_OP_REG_RIGHT_label, \
+		&&SLANG_OP_REG_UNBOX_label, \
+		&&SLANG_OP_REG_CJUMP_label, \
+		&&SLANG_OP_REG_CNJUMP_label, \
+		&&SLANG_OP_REG_RET_label, \
+		&&SLANG_OP_ADD_II_label, \
+		&&SLANG_OP_SUB_II_label, \
+		&&SLANG_OP_MUL_II_label, \
+		&&SLANG_OP_DIV_II_label, \
+		&&SLANG_OP_ADD_RR_label, \
+		&&SLANG_OP_SUB_RR_label, \
+		&&SLANG_OP_MUL_RR_label, \
+		&&SLANG_OP_DIV_RR_label, \
+		&&SLANG_OP_JIT_ENTER_label, \
 	}; \
 	static_assert(SL_ARR_LEN(blocks)==SLANG_OP_COUNT); \
+	PROFILE_OPS_START() \
 	op = *c->pc; \
 	goto *blocks[op]; \
 	while (true){
@@ -10738,6 +13569,11 @@ bool CodeFuncApply(CodeInterpreter* c){
 #undef LOOP_POST
 #undef LOOP_INST
 #undef NEXT_INST
+#undef PROFILE_POLL
+
+#ifdef SLANG_JIT
+#include "jit.cpp.inc"
+#endif
 
 inline bool CodeInterpreter::InlineStep(){
 	SingleStep(this);
@@ -10777,6 +13613,10 @@ void CodeInterpreter::ResetState(){
 	pc = nullptr;
 	stepCount = 0;
 	gSmallGCs = 0;
+	gMinorGCs = 0;
+	gParallelGCs = 0;
+	gGCPauseTotal = 0.0;
+	gGCPauseMax = 0.0;
 	
 	stack.Clear();
 	funcStack.Clear();
@@ -10786,12 +13626,18 @@ void CodeInterpreter::ResetState(){
 
 void CodeInterpreter::SetupDefaultModule(const std::string& name){
 	currModuleName = 0;
+	for (size_t i=0;i<modules.size;++i){
+		modules.data[i].globalIndex.Free();
+		modules.data[i].exportIndex.Free();
+	}
 	modules.Clear();
 	moduleNameDict.clear();
 	SlangEnv* global = AllocateEnvs(4);
 	ModuleData& md = modules.PlaceBack();
 	md.globalEnv = global;
 	md.exportEnv = nullptr;
+	md.globalIndex.Init(global);
+	md.exportIndex.Init(nullptr);
 	RegisterModuleName(name);
 }
 
@@ -10895,6 +13741,101 @@ bool CodeInterpreter::Run(){
 	return success;
 }
 
+#ifndef _WIN32
+static void ProfileSignalHandler(int){
+	gProfileTicks.fetch_add(1,std::memory_order_relaxed);
+}
+#endif
+
+bool StartSampleProfiler(uint32_t hz){
+#ifdef _WIN32
+	(void)hz;
+	return false;
+#else
+	struct sigaction sa{};
+	sa.sa_handler = ProfileSignalHandler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	if (sigaction(SIGPROF,&sa,nullptr)!=0)
+		return false;
+	
+	// ITIMER_PROF counts cpu time so blocking io isn't sampled
+	struct itimerval timer{};
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = 1000000/hz;
+	timer.it_value = timer.it_interval;
+	return setitimer(ITIMER_PROF,&timer,nullptr)==0;
+#endif
+}
+
+void StopSampleProfiler(){
+#ifndef _WIN32
+	struct itimerval timer{};
+	setitimer(ITIMER_PROF,&timer,nullptr);
+	signal(SIGPROF,SIG_IGN);
+#endif
+	gProfileTicks = 0;
+}
+
+void CodeInterpreter::AppendProfileFrame(std::string& out,size_t funcIndex,const uint8_t* framePc) const {
+	const CodeBlock& block = codeWriter.lambdaCodes[funcIndex];
+	if (block.name==LET_SELF_SYM)
+		out += "<let>";
+	else if (block.name!=EMPTY_NAME)
+		out += parser.GetSymbolString(block.name);
+	else if (funcIndex==0)
+		out += "<main>";
+	else
+		out += "<lambda>";
+	
+	if (framePc<block.start||framePc>block.write)
+		return;
+	
+	LocationData loc = codeWriter.FindCodeLocation(funcIndex,framePc-block.start);
+	if (loc.line==-1U)
+		return;
+	out += ' ';
+	out += GetModuleString(loc.moduleName);
+	out += ':';
+	out += std::to_string(loc.line+1);
+}
+
+// every tick since the last poll fired while this stack was running
+void CodeInterpreter::TakeProfileSample(){
+	uint32_t ticks = gProfileTicks.exchange(0,std::memory_order_relaxed);
+	if (funcStack.size==0)
+		return;
+	
+	std::string folded{};
+	size_t start = 0;
+	if (funcStack.size>PROFILE_MAX_DEPTH){
+		start = funcStack.size-PROFILE_MAX_DEPTH;
+		folded = "...;";
+	}
+	for (size_t i=start;i<funcStack.size;++i){
+		// a caller's pc is where its callee will return to
+		const uint8_t* framePc = pc;
+		if (i+1<funcStack.size)
+			framePc = funcStack.data[i+1].retAddr;
+		if (i!=start)
+			folded += ';';
+		AppendProfileFrame(folded,funcStack.data[i].funcIndex,framePc);
+	}
+	profileSamples[folded] += ticks;
+}
+
+bool CodeInterpreter::WriteProfileSamples(const std::string& filename) const {
+	std::ofstream f(filename);
+	if (!f)
+		return false;
+	
+	std::vector<std::pair<std::string,size_t>> sorted(profileSamples.begin(),profileSamples.end());
+	std::sort(sorted.begin(),sorted.end());
+	for (const auto& [stack,count] : sorted){
+		f << stack << ' ' << count << '\n';
+	}
+	return true;
+}
 
 inline void* CodeInterpreterConstAllocate(void* data,size_t mem){
 	MemChain* chain = (MemChain*)data;
@@ -10911,10 +13852,12 @@ CodeInterpreter::CodeInterpreter()
 	  evalAlloc(&evalMemChain,CodeInterpreterConstAllocate){
 	gRandState.Seed(GetSeedTime());
 	arena = new MemArena();
+	alloc.arena = arena;
 	
-	size_t memSize = SMALL_SET_SIZE*2;
+	size_t memSize = QuantizeSize16(gGCConfig.minHeap*2);
 	uint8_t* memAlloc = (uint8_t*)malloc(memSize);
 	arena->SetSpace(memAlloc,memSize,memAlloc);
+	arena->SetNursery((uint8_t*)malloc(NURSERY_SIZE),NURSERY_SIZE);
 	gArenaSize = memSize;
 	gMaxArenaSize = memSize;
 	
@@ -10924,6 +13867,9 @@ CodeInterpreter::CodeInterpreter()
 	tryStack.Reserve(16);
 	modules.Reserve(16);
 	finalizers.Reserve(8);
+	rememberedSet.Reserve(64);
+	gcEpoch = 1;
+	nurseryCached = false;
 	gDebugInterpreter = this;
 	
 	InitBuiltinModules();
@@ -10937,8 +13883,18 @@ CodeInterpreter::~CodeInterpreter(){
 		finalizer.func(this,finalizer.obj);
 	}
 	
+	for (size_t i=0;i<modules.size;++i){
+		modules.data[i].globalIndex.Free();
+		modules.data[i].exportIndex.Free();
+	}
+	
 	if (arena->memSet)
 		free(arena->memSet);
+	if (arena->nursery)
+		free(arena->nursery);
+	for (size_t i=0;i<arena->largeObjects.size;++i){
+		free(arena->largeObjects.data[i]);
+	}
 	delete arena;
 	gDebugInterpreter = nullptr;
 }
@@ -10975,7 +13931,8 @@ bool PrintListException(std::ostream& os,const SlangList* list){
 
 std::ostream& operator<<(std::ostream& os,const SlangHeader& obj){
 	double r;
-	switch (obj.type){
+	// immediates are identified by address and never read through
+	switch (GetType(&obj)){
 		case SlangType::Env:
 			os << "[ENV]";
 			break;
@@ -10997,11 +13954,16 @@ std::ostream& operator<<(std::ostream& os,const SlangHeader& obj){
 		case SlangType::OutputStream:
 			os << "[ostream]";
 			break;
+		case SlangType::Iterator: {
+			SlangIter* it = (SlangIter*)&obj;
+			os << "[range " << it->pos << ' ' << it->pos+it->count*it->step << ' ' << it->step << ']';
+			break;
+		}
 		case SlangType::Int:
-			os << ((SlangObj*)&obj)->integer;
+			os << GetInt(&obj);
 			break;
 		case SlangType::Real:
-			r = ((SlangObj*)&obj)->real;
+			r = GetReal(&obj);
 			os << r;
 			if (r==floor(r)&&abs(r)<1e16)
 				os << ".0";
@@ -11102,6 +14064,31 @@ std::ostream& operator<<(std::ostream& os,const SlangHeader& obj){
 			os << "]";
 			break;
 		}
+		case SlangType::Packed: {
+			const SlangPacked* packed = (SlangPacked*)&obj;
+			const char* prefixes[] = {"#i64[","#f64[","#u8["};
+			os << prefixes[packed->header.packKind];
+			for (size_t i=0;i<packed->GetLength();++i){
+				if (i!=0)
+					os << ' ';
+				switch (packed->header.packKind){
+					case PACK_F64:
+						r = packed->F64()[i];
+						os << r;
+						if (r==floor(r)&&abs(r)<1e16)
+							os << ".0";
+						break;
+					case PACK_U8:
+						os << (int)packed->storage->data[i];
+						break;
+					default:
+						os << packed->I64()[i];
+						break;
+				}
+			}
+			os << "]";
+			break;
+		}
 		case SlangType::Dict: {
 			SlangStorage* storage = ((SlangDict*)&obj)->storage;
 			
@@ -11137,7 +14124,7 @@ std::ostream& operator<<(std::ostream& os,const SlangHeader& obj){
 			break;
 		}
 		case SlangType::Bool:
-			if (obj.boolVal){
+			if (GetBool(&obj)){
 				os << "true";
 			} else {
 				os << "false";
@@ -11155,7 +14142,7 @@ std::ostream& operator<<(std::ostream& os,const SlangHeader& obj){
 			SlangList* next = (SlangList*)list->right;
 			while (next){
 				os << ' ';
-				if(next->header.type!=SlangType::List){
+				if(GetType((SlangHeader*)next)!=SlangType::List){
 					os << ". " << *(SlangHeader*)next;
 					break;
 				}
@@ -11,11 +11,42 @@
 #include <assert.h>
 #include <cstring>
 #include <iostream>
+#include <bit>
+#include <csignal>
+#include <atomic>
 
 #define SMALL_SET_SIZE 65536
+#define NURSERY_SIZE (SMALL_SET_SIZE*4)
+// storage at least this big is malloced on its own and never moved
+#define LARGE_STORAGE_SIZE (SMALL_SET_SIZE/2)
+#define LARGE_SPACE_MIN (SMALL_SET_SIZE*16)
+// no storage bigger than this can be mapped, bigger requests fail early
+#define MAX_STORAGE_SIZE (1ULL<<47)
 #define FORWARD_MASK (~7ULL)
+// forwarded with no address yet, a parallel gc is copying the object
+#define FORWARD_BUSY 1ULL
 #define DICT_UNOCCUPIED_VAL UINT64_MAX
 #define SLANG_ENV_BLOCK_SIZE 4
+#define NO_CAPTURE UINT16_MAX
+// immediates are stored directly in the SlangHeader* slot
+// ..01 is a 62 bit int, ..10 is a bool/eof constant
+#define SLANG_IMM_TAG_MASK 3ULL
+#define SLANG_IMM_INT_TAG 1ULL
+#define SLANG_IMM_INT_SHIFT 2
+#ifdef SLANG_NAN_BOXING
+// reals are offset above 2^48 where no pointer can reach,
+// ints shrink to 46 bits so they stay below it too
+#define SLANG_NAN_BOX_OFFSET (1ULL<<48)
+#define SLANG_NAN_BOX_CANON_NAN 0x7FF8000000000000ULL
+#define SLANG_IMM_INT_MIN (-(1LL<<45))
+#define SLANG_IMM_INT_MAX ((1LL<<45)-1)
+#else
+#define SLANG_IMM_INT_MIN (INT64_MIN>>SLANG_IMM_INT_SHIFT)
+#define SLANG_IMM_INT_MAX (INT64_MAX>>SLANG_IMM_INT_SHIFT)
+#endif
+#define SLANG_IMM_FALSE ((SlangHeader*)0b0010ULL)
+#define SLANG_IMM_TRUE ((SlangHeader*)0b0110ULL)
+#define SLANG_IMM_EOF ((SlangHeader*)0b1010ULL)
 #define SL_ARR_LEN(x) (sizeof(x)/sizeof(x[0]))
 
 #define SLANG_VERSION "0.1.0"
@@ -159,15 +190,16 @@ namespace slang {
 		}
 	};
 	
+	// fnv-1a, generated names like x0..x9999 only differ in their
+	// last few chars and cluster badly under a plain rotate/xor
 	inline uint64_t HashSymbolNameFromSV(std::string_view sv){
-		uint64_t hash = 0;
+		uint64_t hash = 0xCBF29CE484222325ULL;
 		
 		for (size_t i=0;i<sv.size();++i){
-			hash = rotleft(hash,1);
-			hash ^= sv[i];
+			hash ^= (uint8_t)sv[i];
+			hash *= 0x100000001B3ULL;
 		}
-		hash ^= sv.size();
-		return hash;
+		return hash^(hash>>32);
 	}
 	
 	struct StringLocation {
@@ -370,6 +402,43 @@ namespace slang {
 	};
 	
 	void PrintInfo();
+#ifdef SLANG_PROFILE_OPS
+	extern bool gProfileOps;
+	void PrintOpProfile();
+#endif
+	// timer ticks not yet charged to a stack, counted by the sampling
+	// timer and polled at calls, returns and after builtins
+	extern std::atomic<uint32_t> gProfileTicks;
+	bool StartSampleProfiler(uint32_t hz);
+	void StopSampleProfiler();
+#ifdef SLANG_JIT
+#if !defined(__x86_64__)||defined(_WIN32)
+#error "SLANG_JIT needs x86-64 with the System V calling convention"
+#endif
+	// calls into a block before it's compiled, 0 turns the jit off
+	extern uint32_t gJitThreshold;
+	struct JitCode;
+	void FreeJitCode(JitCode*);
+#endif
+	// threads copying during large collections, 1 keeps the gc serial
+	extern size_t gGCThreads;
+	
+	// heap sizing policy, sizes are per set like gc-mem-cap
+	struct GCConfig {
+		// starting set size and the floor shrinking stops at
+		size_t minHeap = SMALL_SET_SIZE;
+		// 0 leaves the heap unbounded
+		size_t maxHeap = 0;
+		// a set with less than 1/4 free grows by this much
+		double growFactor = 1.5;
+		// a set with more than this fraction free shrinks
+		double shrinkFree = 0.875;
+		// prints a line to stderr after every collection
+		bool trace = false;
+	};
+	extern GCConfig gGCConfig;
+	// returns what's wrong with config, or nullptr if it's usable
+	const char* CheckGCConfig(const GCConfig& config);
 	
 	enum class SlangType : uint8_t {
 		NullType,
@@ -387,6 +456,8 @@ namespace slang {
 		OutputStream,
 		EndOfFile,
 		Maybe,
+		Iterator,
+		Packed,
 		// inaccessible
 		Env,
 		Storage,
@@ -395,10 +466,13 @@ namespace slang {
 	
 	enum SlangFlag {
 		FLAG_FORWARDED =          0b1,
+		FLAG_REMEMBERED =        0b10,
+		FLAG_LARGE =            0b100,
 		FLAG_VARIADIC =        0b1000,
 		FLAG_MAYBE_OCCUPIED = 0b10000,
 		FLAG_CLOSURE =       0b100000,
 		FLAG_EXTERNAL =     0b1000000,
+		FLAG_MARKED =      0b10000000,
 	};
 	
 	struct SlangHeader {
@@ -412,6 +486,8 @@ namespace slang {
 					uint8_t isFile;
 					uint8_t boolVal;
 					uint8_t dictScale;
+					uint8_t iterKind;
+					uint8_t packKind;
 					uint8_t padding[6];
 				};
 			};
@@ -423,6 +499,29 @@ namespace slang {
 			forwarded = (SlangHeader*)((uint64_t)f | 1ULL);
 		}
 		
+		// claims the object for copying unless another thread already
+		// did, seen is left holding the current header or forward
+		inline bool ClaimForward(SlangHeader*& seen){
+			std::atomic_ref<SlangHeader*> ref{forwarded};
+			seen = ref.load(std::memory_order_acquire);
+			while (!((uint64_t)seen & 1ULL)){
+				if (ref.compare_exchange_weak(seen,(SlangHeader*)FORWARD_BUSY,
+						std::memory_order_acq_rel,std::memory_order_acquire))
+					return true;
+			}
+			return false;
+		}
+		
+		inline void ForwardAtomic(SlangHeader* f){
+			std::atomic_ref<SlangHeader*> ref{forwarded};
+			ref.store((SlangHeader*)((uint64_t)f | 1ULL),std::memory_order_release);
+		}
+		
+		inline SlangHeader* LoadForwarded(){
+			std::atomic_ref<SlangHeader*> ref{forwarded};
+			return ref.load(std::memory_order_acquire);
+		}
+		
 		inline bool IsForwarded() const {
 			return (uint64_t)forwarded & 1ULL;
 		}
@@ -501,6 +600,35 @@ namespace slang {
 		}
 	};
 	
+	enum SlangPackKind : uint8_t {
+		PACK_I64,
+		PACK_F64,
+		PACK_U8,
+	};
+	
+	inline uint16_t PackElemSize(uint8_t kind){
+		return (kind==PACK_U8) ? 1 : 8;
+	}
+	
+	// numbers stored unboxed in the storage data, so the gc never
+	// looks past the storage pointer
+	struct SlangPacked {
+		SlangHeader header;
+		SlangStorage* storage;
+		
+		inline size_t GetLength() const {
+			return (!storage) ? 0 : storage->size;
+		}
+		
+		inline int64_t* I64() const {
+			return (int64_t*)storage->data;
+		}
+		
+		inline double* F64() const {
+			return (double*)storage->data;
+		}
+	};
+	
 	struct SlangList {
 		SlangHeader header;
 		SlangHeader* left;
@@ -510,6 +638,26 @@ namespace slang {
 	uint64_t SlangHashObj(const SlangHeader* obj);
 	bool EqualObjs(const SlangHeader* a,const SlangHeader* b);
 	
+	// ranges are the only iterators user code sees, the cursors live
+	// in the arg slots of map, foreach, filter and fold
+	enum SlangIterKind : uint8_t {
+		ITER_RANGE,
+		ITER_RANGE_CURSOR,
+		ITER_VEC_CURSOR,
+		ITER_STR_CURSOR,
+		ITER_DICT_CURSOR,
+		ITER_PACKED_CURSOR,
+	};
+	
+	struct SlangIter {
+		SlangHeader header;
+		// what a cursor walks, null for ranges
+		SlangHeader* source;
+		int64_t pos;
+		int64_t step;
+		int64_t count;
+	};
+	
 	struct SlangDictTable {
 		SlangHeader header;
 		size_t size;
@@ -730,8 +878,91 @@ namespace slang {
 		size_t maxArgs = 0;
 	};*/
 	
+#ifdef SLANG_NAN_BOXING
+	inline bool IsImmReal(const SlangHeader* o){
+		return (uint64_t)o>=SLANG_NAN_BOX_OFFSET;
+	}
+	
+	inline bool IsImmediate(const SlangHeader* o){
+		return ((uint64_t)o & SLANG_IMM_TAG_MASK) || IsImmReal(o);
+	}
+	
+	inline bool IsImmInt(const SlangHeader* o){
+		return ((uint64_t)o & SLANG_IMM_INT_TAG) && !IsImmReal(o);
+	}
+	
+	inline SlangHeader* MakeImmReal(double r){
+		uint64_t bits = std::bit_cast<uint64_t>(r);
+		if (r!=r) bits = SLANG_NAN_BOX_CANON_NAN;
+		return (SlangHeader*)(bits+SLANG_NAN_BOX_OFFSET);
+	}
+	
+	inline double GetReal(const SlangHeader* o){
+		return std::bit_cast<double>((uint64_t)o-SLANG_NAN_BOX_OFFSET);
+	}
+#else
+	inline bool IsImmReal(const SlangHeader*){
+		return false;
+	}
+	
+	inline bool IsImmediate(const SlangHeader* o){
+		return (uint64_t)o & SLANG_IMM_TAG_MASK;
+	}
+	
+	inline bool IsImmInt(const SlangHeader* o){
+		return (uint64_t)o & SLANG_IMM_INT_TAG;
+	}
+	
+	inline double GetReal(const SlangHeader* o){
+		return ((const SlangObj*)o)->real;
+	}
+#endif
+	
+	inline bool FitsImmInt(int64_t i){
+		return i>=SLANG_IMM_INT_MIN && i<=SLANG_IMM_INT_MAX;
+	}
+	
+	inline SlangHeader* MakeImmInt(int64_t i){
+		uint64_t bits = ((uint64_t)i<<SLANG_IMM_INT_SHIFT)|SLANG_IMM_INT_TAG;
+#ifdef SLANG_NAN_BOXING
+		bits &= SLANG_NAN_BOX_OFFSET-1;
+#endif
+		return (SlangHeader*)bits;
+	}
+	
+	// works on both immediate and boxed ints
+	inline int64_t GetInt(const SlangHeader* o){
+		if (IsImmInt(o)){
+#ifdef SLANG_NAN_BOXING
+			return ((int64_t)o<<16)>>(16+SLANG_IMM_INT_SHIFT);
+#else
+			return (int64_t)o>>SLANG_IMM_INT_SHIFT;
+#endif
+		}
+		return ((const SlangObj*)o)->integer;
+	}
+	
+	inline SlangHeader* MakeImmBool(bool b){
+		return b ? SLANG_IMM_TRUE : SLANG_IMM_FALSE;
+	}
+	
+	inline bool GetBool(const SlangHeader* o){
+		return o==SLANG_IMM_TRUE;
+	}
+	
+	// indexed by the low 4 bits of an immediate
+	constexpr SlangType gImmediateTypes[16] = {
+		SlangType::NullType,SlangType::Int,SlangType::Bool,SlangType::Int,
+		SlangType::NullType,SlangType::Int,SlangType::Bool,SlangType::Int,
+		SlangType::NullType,SlangType::Int,SlangType::EndOfFile,SlangType::Int,
+		SlangType::NullType,SlangType::Int,SlangType::Bool,SlangType::Int
+	};
+	
 	inline SlangType GetType(const SlangHeader* expr){
+		if (IsImmReal(expr)) return SlangType::Real;
 		if (!expr) return SlangType::NullType;
+		if ((uint64_t)expr&SLANG_IMM_TAG_MASK) [[unlikely]]
+			return gImmediateTypes[(uint64_t)expr&15];
 		return expr->type;
 	}
 	
@@ -746,8 +977,10 @@ namespace slang {
 			case SlangType::OutputStream:
 			case SlangType::EndOfFile:
 			case SlangType::Maybe:
+			case SlangType::Iterator:
 			case SlangType::Bool:
 			case SlangType::Vector:
+			case SlangType::Packed:
 			case SlangType::String:
 			case SlangType::Dict:
 			case SlangType::Storage:
@@ -771,7 +1004,23 @@ namespace slang {
 	}
 	
 	inline bool IsList(const SlangHeader* o){
-		return o==nullptr||o->type==SlangType::List;
+		return o==nullptr||GetType(o)==SlangType::List;
+	}
+	
+	// anything map, foreach, filter and fold can walk
+	inline bool IsIterable(const SlangHeader* o){
+		switch (GetType(o)){
+			case SlangType::NullType:
+			case SlangType::List:
+			case SlangType::Iterator:
+			case SlangType::Vector:
+			case SlangType::Packed:
+			case SlangType::String:
+			case SlangType::Dict:
+				return true;
+			default:
+				return false;
+		}
 	}
 	
 	inline size_t QuantizeSize(size_t size){
@@ -794,6 +1043,17 @@ namespace slang {
 		uint8_t* otherSet = nullptr;
 		
 		uint8_t* currPointer = nullptr;
+		// objects allocated straight into currSet since the last
+		// collection start here, they're filled in without a barrier
+		uint8_t* directStart = nullptr;
+		
+		// young objects are bump allocated here and promoted
+		// into currSet when it fills up
+		uint8_t* nursery = nullptr;
+		uint8_t* nurseryPointer = nullptr;
+		size_t nurserySize = 0;
+		// anything bigger is pretenured straight into currSet
+		size_t pretenureSize = 0;
 		
 		inline void SetSpace(uint8_t* ptr,size_t size,uint8_t* newCurr){
 			assert((size&7) == 0);
@@ -801,6 +1061,7 @@ namespace slang {
 			memSet = ptr;
 			currSet = ptr;
 			currPointer = newCurr;
+			directStart = newCurr;
 			otherSet = ptr+size/2;
 			memSize = size;
 		}
@@ -815,14 +1076,55 @@ namespace slang {
 			return obj>=&currSet[0] && 
 					obj<(&currSet[0]+memSize/2);
 		}
+		
+		inline void SetNursery(uint8_t* ptr,size_t size){
+			assert((size&7) == 0);
+			assert(((uint64_t)ptr&7) == 0);
+			nursery = ptr;
+			nurseryPointer = ptr;
+			nurserySize = size;
+			pretenureSize = size/4;
+		}
+		
+		inline bool InNursery(const uint8_t* obj) const {
+			return obj>=nursery && obj<nursery+nurserySize;
+		}
+		
+		inline bool InHeap(const uint8_t* obj) const {
+			return InNursery(obj) || InCurrSet(obj);
+		}
+		
+		inline size_t NurseryUsed() const {
+			return nurseryPointer-nursery;
+		}
+		
+		// large objects are swept after each SmallGC, going over
+		// largeLimit forces the next minor collection to be a full one
+		Vector<SlangHeader*> largeObjects;
+		size_t largeSize = 0;
+		size_t largeLimit = LARGE_SPACE_MIN;
+		
+		inline uint8_t* AllocateLarge(size_t size){
+			SlangHeader* obj = (SlangHeader*)malloc(size);
+			if (!obj)
+				return nullptr;
+			obj->flags = FLAG_LARGE;
+			largeObjects.PushBack(obj);
+			largeSize += size;
+			return (uint8_t*)obj;
+		}
 	};
 	
 	typedef void*(*AllocFunc)(void*,size_t);
 	struct SlangAllocator {
 		void* user;
 		AllocFunc alloc;
+		// if set its nursery is bump allocated inline, alloc is
+		// only called once the nursery is full
+		MemArena* arena = nullptr;
 		
 		inline uint8_t* Allocate(size_t);
+		inline uint8_t* AllocateStorageMem(size_t);
 		inline SlangObj* AllocateObj(SlangType);
 		inline SlangLambda* AllocateLambda();
 		inline SlangList* AllocateList();
@@ -834,9 +1136,11 @@ namespace slang {
 		inline SlangVec* AllocateVec(size_t);
 		inline SlangStr* AllocateStr(size_t);
 		inline SlangStream* AllocateStream(SlangType);
+		inline SlangIter* AllocateIter(uint8_t kind);
+		inline SlangPacked* AllocatePacked(uint8_t kind,size_t);
 		
-		inline SlangObj* MakeInt(int64_t);
-		inline SlangObj* MakeReal(double);
+		inline SlangHeader* MakeInt(int64_t);
+		inline SlangHeader* MakeReal(double);
 		inline SlangObj* MakeSymbol(SymbolName);
 		inline SlangHeader* MakeBool(bool);
 		inline SlangHeader* MakeEOF();
@@ -961,13 +1265,20 @@ namespace slang {
 		SymbolName name;
 		ParamData params;
 		ParamData defs;
+		// flat closure record layout, copied in at creation
+		ParamData captures;
 		Vector<CodeLocationPair> locData;
 		uint32_t moduleIndex;
+		uint16_t selfCapture;
 		uint8_t isVariadic;
 		uint8_t isClosure;
 		uint8_t isPure;
 		uint8_t* start;
 		uint8_t* write;
+#ifdef SLANG_JIT
+		JitCode* jit;
+		uint32_t callCount;
+#endif
 	};
 	
 	struct LambdaData {
@@ -975,15 +1286,38 @@ namespace slang {
         ParamData params;
 		ParamData defs;
 		Vector<size_t> paramHeights;
+		ParamData captures = {};
+		// params and defs that live in boxes, initBoxed let
+		// params are boxed as they're inited instead of on entry
+		std::set<SymbolName> boxed = {};
+		std::set<SymbolName> initBoxed = {};
 		size_t defHeightsStart = 0;
 		bool isVariadic = false;
-		bool isClosure = false;
 		bool isStar = false;
 		bool isLetRec = false;
+		// funcName is a global def, so it isn't captured
+		bool globalName = false;
+		uint16_t selfCapture = NO_CAPTURE;
 		uint16_t currLetInit = 0;
 		uint32_t currInternalDef = 0;
 	};
 	
+	enum VarLocation : uint8_t {
+		VAR_GLOBAL,
+		VAR_STACK,
+		VAR_LOCAL,
+		VAR_CAPTURE
+	};
+	
+	struct VarRef {
+		size_t level;
+		size_t selfLevel;
+		uint32_t index;
+		uint32_t defIndex;
+		uint8_t loc;
+		bool boxed;
+	};
+	
 	struct CaseDictElement {
 		const SlangHeader* key;
 		size_t offset;
@@ -1066,12 +1400,18 @@ namespace slang {
 		size_t StartTryOp();
 		void FinishTryOp(size_t);
 		
-		bool SymbolInStarParams(SymbolName,uint32_t&) const;
-		bool SymbolInInternalDefs(SymbolName,uint32_t&) const;
-		bool SymbolInParams(SymbolName,uint16_t&) const;
-		bool SymbolNotInAnyParams(SymbolName,uint32_t&) const;
-		bool ParamIsInited(uint16_t) const;
-		void AddClosureParam(SymbolName);
+		void ResolveVar(SymbolName,VarRef&);
+		bool BoundOutside(SymbolName,size_t level,VarRef&) const;
+		size_t SelfLevelOf(SymbolName) const;
+		uint16_t AddCapture(LambdaData&,SymbolName);
+		uint16_t SelfCapture(LambdaData&);
+		bool VarIsInited(const VarRef&) const;
+		void WriteVarRef(const VarRef&);
+		void MarkBoxedVars(
+			const SlangList* body,
+			const std::vector<SlangHeader*>* initExprs,
+			const std::vector<SlangHeader*>& internalDefs
+		);
 		
 		inline bool IsFuncPure(SymbolName) const;
 		inline bool IsLambdaPure(const SlangList*) const;
@@ -1106,6 +1446,7 @@ namespace slang {
 		
 		bool CompileExpr(const SlangHeader*,bool terminating=false);
 		bool CompileConst(const SlangHeader*);
+		bool CompileIterable(const SlangHeader*);
 		bool CompileLambdaBody(
 			const SlangList* exprs,
 			const std::vector<SlangHeader*>* initExprs,
@@ -1154,7 +1495,7 @@ namespace slang {
 		bool CompileExport(const SlangHeader*);
 		bool CompileImport(const SlangHeader*);
 		
-		void Optimize(CodeBlock& block);
+		void Optimize(CodeBlock& block,bool lambdaBody);
 		
 		void Reset();
 		void MakeDefaultObjs();
@@ -1184,7 +1525,6 @@ namespace slang {
 		SlangEnv* env;
 		SlangEnv* globalEnv;
 		const uint8_t* retAddr;
-		bool isClosure;
 	};
 	
 	struct TryData {
@@ -1195,9 +1535,150 @@ namespace slang {
 		size_t globalStackSize;
 	};
 	
+	struct EnvIndexPair {
+		SymbolName sym;
+		size_t pos;
+	};
+	
+	// hashed view of a module env, maps symbols to their position
+	// in the block chain so defs and lookups don't walk it
+	struct EnvIndex {
+		EnvIndexPair* table;
+		size_t tableSize;
+		size_t tableCap;
+		// every block in chain order, kept up to date by the gc
+		SlangEnv** blocks;
+		size_t blockCount;
+		size_t blockCap;
+		// mappings indexed so far
+		size_t count;
+		
+		inline void Init(SlangEnv* head){
+			table = nullptr;
+			tableSize = 0;
+			tableCap = 0;
+			blocks = nullptr;
+			blockCount = 0;
+			blockCap = 0;
+			count = 0;
+			if (!head)
+				return;
+			
+			tableCap = 16;
+			table = (EnvIndexPair*)malloc(sizeof(EnvIndexPair)*tableCap);
+			memset(table,0xFF,sizeof(EnvIndexPair)*tableCap);
+			PushBlock(head);
+			Sync();
+		}
+		
+		inline void Free(){
+			if (table)
+				free(table);
+			if (blocks)
+				free(blocks);
+			Init(nullptr);
+		}
+		
+		inline void PushBlock(SlangEnv* block){
+			if (blockCount==blockCap){
+				blockCap = blockCap*2+4;
+				blocks = (SlangEnv**)realloc(blocks,sizeof(SlangEnv*)*blockCap);
+			}
+			blocks[blockCount++] = block;
+		}
+		
+		inline SlangEnv* BlockAt(size_t pos) const {
+			return blocks[pos/SLANG_ENV_BLOCK_SIZE];
+		}
+		
+		inline SlangMapping* MappingAt(size_t pos) const {
+			return &blocks[pos/SLANG_ENV_BLOCK_SIZE]->mappings[pos%SLANG_ENV_BLOCK_SIZE];
+		}
+		
+		inline SlangEnv* LastBlock() const {
+			return blocks[blockCount-1];
+		}
+		
+		inline size_t Find(SymbolName sym) const {
+			const EnvIndexPair* end = table+tableCap;
+			const EnvIndexPair* it = table+(((sym*0x9E3779B97F4A7C15ULL)>>32)&(tableCap-1));
+			
+			while (true){
+				if (it->sym==sym)
+					return it->pos;
+				if (it->pos==DICT_UNOCCUPIED_VAL)
+					return -1ULL;
+				
+				++it;
+				if (it==end)
+					it = table;
+			}
+		}
+		
+		inline void DoubleTable(){
+			size_t oldCap = tableCap;
+			EnvIndexPair* oldTable = table;
+			tableCap *= 2;
+			tableSize = 0;
+			table = (EnvIndexPair*)malloc(sizeof(EnvIndexPair)*tableCap);
+			memset(table,0xFF,sizeof(EnvIndexPair)*tableCap);
+			
+			for (size_t i=0;i<oldCap;++i){
+				if (oldTable[i].pos!=DICT_UNOCCUPIED_VAL)
+					Insert(oldTable[i].sym,oldTable[i].pos);
+			}
+			free(oldTable);
+		}
+		
+		inline void Insert(SymbolName sym,size_t pos){
+			const EnvIndexPair* end = table+tableCap;
+			EnvIndexPair* it = table+(((sym*0x9E3779B97F4A7C15ULL)>>32)&(tableCap-1));
+			
+			while (it->pos!=DICT_UNOCCUPIED_VAL){
+				++it;
+				if (it==end)
+					it = table;
+			}
+			it->sym = sym;
+			it->pos = pos;
+			++tableSize;
+			
+			if (tableSize*2>tableCap)
+				DoubleTable();
+		}
+		
+		// index mappings added to the chain without going through here,
+		// blocks are filled in order so only the tail needs scanning
+		inline void Sync(){
+			SlangEnv* e = LastBlock();
+			while (true){
+				size_t start = count-(blockCount-1)*SLANG_ENV_BLOCK_SIZE;
+				for (size_t i=start;i<e->header.varCount;++i){
+					if (Find(e->mappings[i].sym)==-1ULL)
+						Insert(e->mappings[i].sym,count);
+					++count;
+				}
+				if (e->header.varCount<SLANG_ENV_BLOCK_SIZE||!e->next)
+					break;
+				e = e->next;
+				PushBlock(e);
+			}
+		}
+		
+		inline size_t Lookup(SymbolName sym){
+			size_t pos = Find(sym);
+			if (pos!=-1ULL)
+				return pos;
+			Sync();
+			return Find(sym);
+		}
+	};
+	
 	struct ModuleData {
 		SlangEnv* globalEnv;
 		SlangEnv* exportEnv;
+		EnvIndex globalIndex;
+		EnvIndex exportIndex;
 	};
 	
 	typedef void(*FinalizerFunc)(CodeInterpreter* s,SlangHeader* obj);
@@ -1219,6 +1700,10 @@ namespace slang {
 		
 		bool halted;
 		size_t stepCount;
+		// bumped whenever cached env blocks move, invalidating
+		// the inline caches of GET_GLOBAL
+		uint32_t gcEpoch;
+		bool nurseryCached;
 		const uint8_t* pc;
 		Vector<StackData> stack;
 		Vector<SlangHeader*> argStack;
@@ -1233,7 +1718,11 @@ namespace slang {
 		
 		std::vector<ErrorData> errors;
 		Vector<Finalizer> finalizers;
+		// old objects that may point into the nursery
+		Vector<SlangHeader*> rememberedSet;
 		SlangEnv* lamEnv;
+		// folded call stack -> sample count
+		std::unordered_map<std::string,size_t> profileSamples;
 		
 		inline ModuleName RegisterModuleName(const std::string& name){
 			if (moduleNameDict.contains(name)){
@@ -1253,12 +1742,6 @@ namespace slang {
 			return "INVALID MODULE";
 		}
 		
-		inline void InternalDef(size_t index,SlangHeader* obj){
-			SlangEnv* env = GetCurrEnv();
-			SymbolName sym = codeWriter.lambdaCodes[funcStack.Back().funcIndex].defs.data[index];
-			DefOrSetEnvSymbol(env,sym,obj);
-		}
-		
 		inline SlangHeader* GetArg(size_t i) const {
 			return argStack.data[stack.Back().base+i];
 		}
@@ -1320,17 +1803,29 @@ namespace slang {
 		}
 		
 		inline void SetLocalArg(uint16_t index,SlangHeader* val){
-			size_t argsFrame = funcStack.Back().argsFrame;
-			SlangEnv* e = funcStack.Back().env;
-			size_t base = stack.data[argsFrame].base;
+			size_t base = stack.data[funcStack.Back().argsFrame].base;
 			argStack.data[base+index] = val;
-			if (codeWriter.lambdaCodes[funcStack.Back().funcIndex].isClosure)
-				e->SetIndexed(index,val);
 		}
 		
 		inline void SetRecLocalArg(uint32_t index,SlangHeader* val){
 			argStack.data[argStack.size-index+1] = val;
 		}
+
+		// register form code numbers its registers from here,
+		// params first, then let values and temporaries
+		inline size_t RegisterBase() const {
+			return stack.data[funcStack.Back().argsFrame].base;
+		}
+
+		// at is never past the top, so it's at most one push
+		inline void SetTopRegister(size_t at,SlangHeader* val){
+			if (at>=argStack.cap){
+				argStack.data = (SlangHeader**)realloc(argStack.data,argStack.cap*2*sizeof(SlangHeader*));
+				argStack.cap *= 2;
+			}
+			argStack.data[at] = val;
+			argStack.size = at+1;
+		}
 		
 		inline void PushFrame(){
 			if (stack.size>=stack.cap){
@@ -1352,14 +1847,28 @@ namespace slang {
 			return funcStack.Back().env;
 		}
 		
+		inline EnvIndex& GetGlobalIndex(){
+			size_t moduleIndex = codeWriter.lambdaCodes[funcStack.Back().funcIndex].moduleIndex;
+			return modules.data[moduleIndex].globalIndex;
+		}
+		
 		inline void PushTry();
 		inline void LoadTry();
 		
-		inline bool GetStackSymbol(size_t funcFrame,SymbolName sym,SlangHeader** res);
-		inline void Call(size_t funcIndex,SlangEnv* env,bool isClosure);
-		inline void RetCall(size_t funcIndex,SlangEnv* env,bool isClosure);
+		inline void Call(size_t funcIndex,SlangEnv* env);
+		inline void RetCall(size_t funcIndex,SlangEnv* env);
 		inline void Recurse();
+		inline void MoveArgsDown();
+		inline const uint8_t* BlockEntry(CodeBlock& cb);
 		inline void Return(SlangHeader* val);
+#ifdef SLANG_JIT
+		// bytecode the jit enter stub resumes native code at
+		const uint8_t* jitResume;
+		inline bool JitReady(CodeBlock& cb);
+		inline bool JitEnters(const CodeBlock& cb,const uint8_t* at);
+		bool JitCompile(CodeBlock& cb);
+		void RunJit();
+#endif
 		
 		inline void RetCallBuiltin(){
 			StackData& d = stack.Back();
@@ -1381,11 +1890,16 @@ namespace slang {
 		inline SlangEnv* AllocateEnvs(size_t);
 		inline void DefEnvSymbol(SlangEnv* e,SymbolName name,SlangHeader* val);
 		void DefOrSetEnvSymbol(SlangEnv* e,SymbolName name,SlangHeader* val);
-		inline void DefCurrEnvSymbol(SymbolName name,SlangHeader* val);
-		inline bool SetRecursiveSymbol(SymbolName name,SlangHeader* val);
+		inline void DefIndexedSymbol(EnvIndex& index,SymbolName name,SlangHeader* val);
 		inline SlangLambda* CreateLambda(size_t index);
+		inline SlangLambda* CreateClosure(size_t index);
 		inline SlangList* MakeVariadicList(size_t start,size_t end);
 		inline SlangVec* MakeVecFromArgs(size_t start,size_t end);
+		inline bool MakeCursor(size_t idx);
+		bool CursorNext(size_t idx);
+		inline bool IterNext(size_t idx);
+		inline void StartVecResult(size_t start,size_t count,size_t resIdx);
+		inline void AppendToVec(size_t vecIdx,size_t valIdx);
 		SlangHeader* Copy(SlangHeader*);
 		inline SlangList* CopyList(SlangList*);
 		inline void RehashDict(SlangDict* dict);
@@ -1413,7 +1927,22 @@ namespace slang {
 		inline bool SlangOutputToString(SlangStream* stream,SlangHeader* obj);
 		inline SlangHeader* SlangInputFromString(SlangStream* stream);
 		
+		inline void RememberObj(SlangHeader* obj){
+			if (arena->InCurrSet((uint8_t*)obj) && !(obj->flags & FLAG_REMEMBERED)){
+				obj->flags |= FLAG_REMEMBERED;
+				rememberedSet.PushBack(obj);
+			}
+		}
+		
+		// call after storing val into obj whenever obj could
+		// have been promoted since it was allocated
+		inline void WriteBarrier(const void* obj,const SlangHeader* val){
+			if (arena->InNursery((const uint8_t*)val))
+				RememberObj((SlangHeader*)obj);
+		}
+		
 		inline void ReallocSet(size_t newSize);
+		inline void MinorGC();
 		inline void SmallGC(size_t);
 		
 		CodeInterpreter();
@@ -1437,6 +1966,10 @@ namespace slang {
 		bool LoadExpr(const std::string& code);
 		bool Run();
 		
+		void AppendProfileFrame(std::string& out,size_t funcIndex,const uint8_t* framePc) const;
+		void TakeProfileSample();
+		bool WriteProfileSamples(const std::string& filename) const;
+		
 		bool EvalCall(SlangHeader*);
 		
 		void DisplayErrors() const;
@@ -1458,6 +1991,7 @@ namespace slang {
 		void ExportError(SymbolName sym);
 		void DotError();
 		void ZeroDivisionError();
+		void MemoryError();
 	};
 	
 	size_t PrintCode(const uint8_t* code,const uint8_t* end,std::ostream&,const uint8_t* pc=nullptr);